@@ -39,7 +39,18 @@
 
 #include "DCIconverter.h"
 
+#include "DCIconverter_SIMD.h"
+#include "DCIconverter_Stats.h"
+
 #include <assert.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+	#include <intrin.h>
+#endif
+
+#include <functional>
+#include <limits>
 
 
 DCIconverterBase::DCIconverterBase(ColorSpace color, ChromaticAdaptation adapt, int temperature) :
@@ -49,6 +60,328 @@ DCIconverterBase::DCIconverterBase(ColorSpace color, ChromaticAdaptation adapt,
 }
 
 
+DCIconverterBase::DCIconverterBase()
+{
+	// Imath matrices start out as identity
+}
+
+
+void
+DCIconverterBase::convertSpan(const float *in, float *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	for(size_t i=0; i < count; i++)
+	{
+		const Pixel outpix = convert( Pixel(in[0], in[1], in[2]) );
+		
+		out[0] = outpix[0];
+		out[1] = outpix[1];
+		out[2] = outpix[2];
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+template <typename T>
+static void
+IntToFloatSpan(const T *in, size_t inStride, float *out, size_t outStride, size_t count, float max)
+{
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = (float)in[0] / max;
+		out[1] = (float)in[1] / max;
+		out[2] = (float)in[2] / max;
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+void
+DCIconverterBase::convertSpan(const unsigned char *in, float *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	IntToFloatSpan(in, inStride, out, outStride, count, MAX_CHAN8);
+	
+	convertSpan(out, out, count, outStride, outStride);
+}
+
+
+void
+DCIconverterBase::convertSpan(const unsigned short *in, float *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	IntToFloatSpan(in, inStride, out, outStride, count, MAX_CHAN16);
+	
+	convertSpan(out, out, count, outStride, outStride);
+}
+
+
+template <typename T>
+static void
+FloatToIntSpan(const float *in, size_t inStride, T *out, size_t outStride, size_t count, float max)
+{
+	for(size_t i=0; i < count; i++)
+	{
+		for(int c=0; c < 3; c++)
+		{
+			const float val = (in[c] >= 1.f ? 1.f : in[c] <= 0.f ? 0.f : in[c]);
+			
+			out[c] = (val * max) + 0.5f;
+		}
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+template <typename T>
+static void
+IntThroughFloatSpan(const DCIconverterBase &converter, const T *in, T *out, size_t count,
+					size_t inStride, size_t outStride, float max)
+{
+	// through a float buffer a chunk at a time, so in and out can be the same
+	const size_t chunk_size = 256;
+	
+	float buf[chunk_size * 3];
+	
+	for(size_t done=0; done < count; done += chunk_size)
+	{
+		const size_t n = (count - done < chunk_size ? count - done : chunk_size);
+		
+		converter.convertSpan(in + (done * inStride), buf, n, inStride, 3);
+		
+		FloatToIntSpan(buf, 3, out + (done * outStride), outStride, n, max);
+	}
+}
+
+
+void
+DCIconverterBase::convertSpan(const unsigned char *in, unsigned char *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	IntThroughFloatSpan(*this, in, out, count, inStride, outStride, MAX_CHAN8);
+}
+
+
+void
+DCIconverterBase::convertSpan(const unsigned short *in, unsigned short *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	IntThroughFloatSpan(*this, in, out, count, inStride, outStride, MAX_CHAN16);
+}
+
+
+static void
+HalfToFloatSpan(const half *in, size_t inStride, float *out, size_t outStride, size_t count)
+{
+	// packed pixels are one run for DCIhalfToFloat
+	if(inStride == 3 && outStride == 3)
+	{
+		DCIhalfToFloat(in, out, count * 3);
+		return;
+	}
+	
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = in[0];
+		out[1] = in[1];
+		out[2] = in[2];
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+static void
+FloatToHalfSpan(const float *in, size_t inStride, half *out, size_t outStride, size_t count)
+{
+	if(inStride == 3 && outStride == 3)
+	{
+		DCIfloatToHalf(in, out, count * 3);
+		return;
+	}
+	
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = in[0];
+		out[1] = in[1];
+		out[2] = in[2];
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+void
+DCIconverterBase::convertSpan(const half *in, float *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	HalfToFloatSpan(in, inStride, out, outStride, count);
+	
+	convertSpan(out, out, count, outStride, outStride);
+}
+
+
+void
+DCIconverterBase::convertSpan(const half *in, half *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	// through a float buffer a chunk at a time, so in and out can be the same
+	const size_t chunk_size = 256;
+	
+	float buf[chunk_size * 3];
+	
+	for(size_t done=0; done < count; done += chunk_size)
+	{
+		const size_t n = (count - done < chunk_size ? count - done : chunk_size);
+		
+		HalfToFloatSpan(in + (done * inStride), inStride, buf, 3, n);
+		
+		convertSpan(buf, buf, n);
+		
+		FloatToHalfSpan(buf, 3, out + (done * outStride), outStride, n);
+	}
+}
+
+
+// Channels compared bit for bit, so NaN matches NaN and -0 doesn't match 0
+static inline unsigned int ChannelBits(unsigned char v) { return v; }
+static inline unsigned int ChannelBits(unsigned short v) { return v; }
+static inline unsigned int ChannelBits(half v) { return v.bits(); }
+static inline unsigned int ChannelBits(float v) { unsigned int b; memcpy(&b, &v, sizeof(b)); return b; }
+
+template <typename T>
+static inline bool
+SamePixel(const T *a, const T *b)
+{
+	return (ChannelBits(a[0]) == ChannelBits(b[0]) &&
+			ChannelBits(a[1]) == ChannelBits(b[1]) &&
+			ChannelBits(a[2]) == ChannelBits(b[2]));
+}
+
+
+template <typename IN_TYPE, typename OUT_TYPE>
+void
+DCIconverterBase::convertRuns(const IN_TYPE *in, OUT_TYPE *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	// Any run of MIN_RUN pixels has two pixels STEP apart on a grid with
+	// that spacing, so only those get compared until two of them match.
+	// Most pixels of a busy frame are never looked at.
+	const size_t STEP = MIN_RUN / 2;
+	
+	size_t start = 0; // first pixel that hasn't been converted
+	size_t k = 0;
+	
+	while(k + STEP < count)
+	{
+		const IN_TYPE *pix = in + (k * inStride);
+		
+		if( !SamePixel(pix + (STEP * inStride), pix) )
+		{
+			k += STEP;
+			continue;
+		}
+		
+		
+		// Find the whole run.  In place, pixels before start have already
+		// been converted, so it can't reach back past that.
+		size_t first = k;
+		size_t end = k + 1;
+		
+		while(first > start && SamePixel(in + ((first - 1) * inStride), pix))
+			first--;
+		
+		while(end < count && SamePixel(in + (end * inStride), pix))
+			end++;
+		
+		if(end - first < MIN_RUN)
+		{
+			k += STEP;
+			continue;
+		}
+		
+		
+		// whatever came before the run, then the run's first pixel, copied to the rest
+		if(first > start)
+			convertSpan(in + (start * inStride), out + (start * outStride), first - start, inStride, outStride);
+		
+		OUT_TYPE *outpix = out + (first * outStride);
+		
+		convertSpan(in + (first * inStride), outpix, 1, inStride, outStride);
+		
+		const OUT_TYPE fill[3] = { outpix[0], outpix[1], outpix[2] };
+		
+		for(size_t j = first + 1; j < end; j++)
+		{
+			outpix += outStride;
+			
+			outpix[0] = fill[0];
+			outpix[1] = fill[1];
+			outpix[2] = fill[2];
+		}
+		
+		start = end;
+		k = end;
+	}
+	
+	if(count > start)
+		convertSpan(in + (start * inStride), out + (start * outStride), count - start, inStride, outStride);
+}
+
+
+template void DCIconverterBase::convertRuns(const float *, float *, size_t, size_t, size_t) const;
+template void DCIconverterBase::convertRuns(const unsigned char *, float *, size_t, size_t, size_t) const;
+template void DCIconverterBase::convertRuns(const unsigned short *, float *, size_t, size_t, size_t) const;
+template void DCIconverterBase::convertRuns(const unsigned char *, unsigned char *, size_t, size_t, size_t) const;
+template void DCIconverterBase::convertRuns(const unsigned short *, unsigned short *, size_t, size_t, size_t) const;
+template void DCIconverterBase::convertRuns(const half *, float *, size_t, size_t, size_t) const;
+template void DCIconverterBase::convertRuns(const half *, half *, size_t, size_t, size_t) const;
+
+
+void
+DCIconverterBase::convertPlanar(const float *const in[3], float *const out[3], size_t count,
+								size_t inStride, size_t outStride) const
+{
+	// interleave a block at a time, so the subclass's convertSpan() does the work
+	const size_t block_size = 256;
+	
+	float buf[block_size * 3];
+	
+	for(size_t done=0; done < count; done += block_size)
+	{
+		const size_t n = (count - done < block_size ? count - done : block_size);
+		
+		for(size_t i=0; i < n; i++)
+		{
+			const size_t pos = (done + i) * inStride;
+			
+			buf[(i * 3) + 0] = in[0][pos];
+			buf[(i * 3) + 1] = in[1][pos];
+			buf[(i * 3) + 2] = in[2][pos];
+		}
+		
+		convertSpan(buf, buf, n);
+		
+		for(size_t i=0; i < n; i++)
+		{
+			const size_t pos = (done + i) * outStride;
+			
+			out[0][pos] = buf[(i * 3) + 0];
+			out[1][pos] = buf[(i * 3) + 1];
+			out[2][pos] = buf[(i * 3) + 2];
+		}
+	}
+}
+
+
 DCIconverterBase::XYZvalue
 DCIconverterBase::TemperatureToWhite(int temperature)
 {
@@ -216,6 +549,12 @@ DCIconverterBase::RGBtoXYZmatrix(ColorSpace color, const XYZvalue *endWhite)
 	
 	
 	
+	// Adapting to the white we already have is the identity, give or take
+	// the rounding in the Bradford matrices, so there's nothing to multiply.
+	if( endWhite->equalWithAbsError(white, 1e-5f) )
+		return RGBtoXYZ;
+	
+	
 	// Calculate the chromatic adaptation matrix using the Bradford method.
 	// We must do this because sRGB and Rec. 709 use the D65 white point,
 	// which is roughly a 6504K color temperature.  But many projector bulbs are
@@ -250,7 +589,7 @@ DCIconverterBase::RGBtoXYZmatrix(ColorSpace color, ChromaticAdaptation adapt, in
 		
 		if(adapt == Temp)
 		{
-			whiteValue = TemperatureToWhite(temperature);
+			return TemperatureMatrix(color, temperature);
 		}
 		else
 		{
@@ -306,141 +645,1174 @@ DCIconverterBase::RGBtoXYZmatrix(ColorSpace color, ChromaticAdaptation adapt, in
 }
 
 
-ForwardDCIconverter::ForwardDCIconverter(ResponseCurve curve, float gamma,
-											ColorSpace color, ChromaticAdaptation adapt, int temperature,
-											bool normalize, float xyz_gamma) :
-	DCIconverterBase(color, adapt, temperature),
-	_curve(curve),
-	_gamma(gamma),
-	_normalize(normalize),
-	_xyz_gamma(xyz_gamma),
-	_rgb2xyz_matrix( DCIconverterBase::_rgb2xyz_matrix )
-{
-
-}
-
-
-static inline float
-GammaFunc(float in, float gamma)
+void
+DCIconverterBase::TemperatureTable(ColorSpace color, std::vector<Matrix> &table)
 {
-	return (in < 0.f ? -powf(-in, gamma) : powf(in, gamma) );
+	table.resize(MAX_TEMPERATURE - MIN_TEMPERATURE + 1);
+	
+	for(int t = MIN_TEMPERATURE; t <= MAX_TEMPERATURE; t++)
+	{
+		const XYZvalue white = TemperatureToWhite(t);
+		
+		table[t - MIN_TEMPERATURE] = RGBtoXYZmatrix(color, &white);
+	}
 }
 
 
-Pixel
-ForwardDCIconverter::convert(const Pixel &pix) const
+Imath::M33f
+DCIconverterBase::TemperatureMatrix(ColorSpace color, float temperature)
 {
-	Pixel rgb = pix;
+	if( !(temperature >= MIN_TEMPERATURE && temperature <= MAX_TEMPERATURE) )
+		throw Iex::LogicExc("Invalid temperature");
 	
-	float &r = rgb[0];
-	float &g = rgb[1];
-	float &b = rgb[2];
+	// one per color space
+	static std::once_flag once[3];
+	static std::vector<Matrix> tables[3];
 	
+	assert(color >= sRGB_Rec709 && color <= P3_RGB);
 	
-	// Video RGB to linear RGB (R'G'B' to RGB)
-	if(_curve == sRGB)
-	{
-		r = sRGBtoLin(r);
-		g = sRGBtoLin(g);
-		b = sRGBtoLin(b);
-	}
-	else if(_curve == Rec709)
-	{
-		r = Rec709toLin(r);
-		g = Rec709toLin(g);
-		b = Rec709toLin(b);
-	}
-	else if(_curve == ProPhotoRGB)
-	{
-		r = ProPhotoRGBtoLin(r);
-		g = ProPhotoRGBtoLin(g);
-		b = ProPhotoRGBtoLin(b);
-	}
-	else if(_curve == P3)
-	{
-		r = GammaFunc(r, 2.6f);
-		g = GammaFunc(g, 2.6f);
-		b = GammaFunc(b, 2.6f);
-	}
-	else if(_curve == Gamma)
-	{
-		r = GammaFunc(r, _gamma);
-		g = GammaFunc(g, _gamma);
-		b = GammaFunc(b, _gamma);
-	}
-	else
-	{
-		assert(_curve == Linear);
-	}
-
+	std::call_once(once[color], &TemperatureTable, color, std::ref(tables[color]));
 	
-	// Convert to XYZ
-	Pixel xyz = rgb * _rgb2xyz_matrix;
+	const std::vector<Matrix> &table = tables[color];
 	
+	const int below = (int)temperature;
+	const float frac = temperature - (float)below;
 	
-	// normalize
-	if(_normalize)
-	{
-		xyz.x *= 48.f / 52.37f;
-		xyz.y *= 48.f / 52.37f;
-		xyz.z *= 48.f / 52.37f;
-	}
+	const Matrix &low = table[below - MIN_TEMPERATURE];
 	
+	if(frac == 0.f)
+		return low;
 	
-	// XYZ to X'Y'Z'
-	xyz.x = GammaFunc(xyz.x, 1.f / _xyz_gamma);
-	xyz.y = GammaFunc(xyz.y, 1.f / _xyz_gamma);
-	xyz.z = GammaFunc(xyz.z, 1.f / _xyz_gamma);
+	const Matrix &high = table[below + 1 - MIN_TEMPERATURE];
 	
+	Matrix m;
 	
-	return xyz;
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
+			m[i][j] = low[i][j] + (high[i][j] - low[i][j]) * frac;
+	
+	return m;
 }
 
 
-inline float
-ForwardDCIconverter::sRGBtoLin(float in)
+static inline float
+GammaFunc(float in, float gamma)
 {
-	// sRGB to linear transfer function
-	// http://en.wikipedia.org/wiki/SRGB
-	// http://www.color.org/chardata/rgb/srgb.xalter
-	
-	return (in <= 0.04045f ? (in / 12.92f) : powf( (in + 0.055f) / 1.055f, 2.4f));
+	return (in < 0.f ? -powf(-in, gamma) : powf(in, gamma) );
 }
 
 
-inline float
-ForwardDCIconverter::Rec709toLin(float in)
+// Span helpers.  Each one runs a single stage of the pipeline over a row
+// so the per-pixel loops don't have to test _curve or _normalize.
+
+template <float CURVE(float)>
+static void
+CurveSpan(const float *in, size_t inStride, float *out, size_t outStride, size_t count)
 {
-	// Rec. 709 to linear transfer function
-	// http://en.wikipedia.org/wiki/Rec._709
-	// http://www.poynton.com/notes/colour_and_gamma/GammaFAQ.html#gamma_correction
-	
-	return (in <= 0.081f ? (in / 4.5f) : powf( (in + 0.099f) / 1.099f, 1.0f / 0.45f));
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = CURVE(in[0]);
+		out[1] = CURVE(in[1]);
+		out[2] = CURVE(in[2]);
+		
+		in += inStride;
+		out += outStride;
+	}
 }
 
 
-inline float
-ForwardDCIconverter::ProPhotoRGBtoLin(float in)
+static void
+GammaSpan(const float *in, size_t inStride, float *out, size_t outStride, size_t count, float gamma)
 {
-	// ProPhotoRGB to linear transfer function.  Inverse of LinToProPhotoRGB spec.
-	// http://en.wikipedia.org/wiki/ProPhoto_RGB_color_space
-	// http://www.color.org/ROMMRGB.pdf
-	
-	return (in < 0.031248f ? (in / 16.f) : powf(in, 1.8f));
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = GammaFunc(in[0], gamma);
+		out[1] = GammaFunc(in[1], gamma);
+		out[2] = GammaFunc(in[2], gamma);
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+// Stage-major execution for the libm loops.  Rather than take each pixel
+// through the curve, matrix and gamma in turn, a block of pixels is
+// deinterleaved into planes and each stage runs over the whole block before
+// the next one starts.  Every stage is then one short loop doing one thing,
+// the matrix vectorizes, and the block stays in L1 from the first stage to
+// the last instead of a row going through memory once per stage.
+
+typedef void (*PlaneFunc)(float *plane, size_t count, float gamma);
+
+typedef struct {
+	PlaneFunc		before;			// each channel before the matrix, NULL for none
+	float			before_gamma;
+	const float		(*matrix)[3];	// planned, normalization included
+	PlaneFunc		after;			// each channel after the matrix, NULL for none
+	float			after_gamma;
+} BlockStages;
+
+
+template <float CURVE(float)>
+static void
+CurvePlane(float *plane, size_t count, float)
+{
+	for(size_t i=0; i < count; i++)
+		plane[i] = CURVE(plane[i]);
+}
+
+
+static void
+GammaPlane(float *plane, size_t count, float gamma)
+{
+	for(size_t i=0; i < count; i++)
+		plane[i] = GammaFunc(plane[i], gamma);
+}
+
+
+static void
+MatrixPlanes(float *r, float *g, float *b, size_t count, const float m[3][3])
+{
+	const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2];
+	const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2];
+	const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2];
+	
+	for(size_t i=0; i < count; i++)
+	{
+		const float x = r[i] * m00 + g[i] * m10 + b[i] * m20;
+		const float y = r[i] * m01 + g[i] * m11 + b[i] * m21;
+		const float z = r[i] * m02 + g[i] * m12 + b[i] * m22;
+		
+		r[i] = x;
+		g[i] = y;
+		b[i] = z;
+	}
+}
+
+
+static void
+BlockedSpan(const float *in, size_t inStride, float *out, size_t outStride, size_t count,
+			const BlockStages &stages)
+{
+	// each stage booked on its own, the copies in and out with the stage next to them
+	ConverterInstruments::StageTimer timer;
+	
+	// three planes of 256 are 3k, with room to spare in any L1
+	const size_t block_size = 256;
+	
+	float r[block_size];
+	float g[block_size];
+	float b[block_size];
+	
+	const float *const planes[3] = { r, g, b };
+	
+	// GammaFunc takes negatives through its sign path, the other curves
+	// through their linear segments
+	const bool count_before = (timer.running() && stages.before == GammaPlane);
+	const bool count_after = (timer.running() && stages.after == GammaPlane);
+	
+	while(count > 0)
+	{
+		const size_t n = (count < block_size ? count : block_size);
+		
+		const float *pix = in;
+		
+		for(size_t i=0; i < n; i++)
+		{
+			r[i] = pix[0];
+			g[i] = pix[1];
+			b[i] = pix[2];
+			
+			pix += inStride;
+		}
+		
+		if(count_before)
+			ConverterInstruments::CountSignPath(planes, n);
+		
+		if(stages.before)
+		{
+			stages.before(r, n, stages.before_gamma);
+			stages.before(g, n, stages.before_gamma);
+			stages.before(b, n, stages.before_gamma);
+		}
+		
+		timer.lap(STATS_DECODE);
+		
+		MatrixPlanes(r, g, b, n, stages.matrix);
+		
+		timer.lap(STATS_MATRIX);
+		
+		if(count_after)
+			ConverterInstruments::CountSignPath(planes, n);
+		
+		if(stages.after)
+		{
+			stages.after(r, n, stages.after_gamma);
+			stages.after(g, n, stages.after_gamma);
+			stages.after(b, n, stages.after_gamma);
+		}
+		
+		float *outpix = out;
+		
+		for(size_t i=0; i < n; i++)
+		{
+			outpix[0] = r[i];
+			outpix[1] = g[i];
+			outpix[2] = b[i];
+			
+			outpix += outStride;
+		}
+		
+		timer.lap(STATS_ENCODE);
+		
+		in += n * inStride;
+		out += n * outStride;
+		count -= n;
+	}
+}
+
+
+template <typename T>
+static void
+TableSpan(const T *in, size_t inStride, float *out, size_t outStride, size_t count,
+			const std::vector<float> &table)
+{
+	ConverterInstruments::Timer timer(STATS_DECODE);
+	
+	const float *lut = &table[0];
+	
+	const unsigned int max = table.size() - 1;
+	
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = lut[ in[0] < max ? in[0] : max ];
+		out[1] = lut[ in[1] < max ? in[1] : max ];
+		out[2] = lut[ in[2] < max ? in[2] : max ];
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+template <typename T>
+static void
+HalfTableSpan(const half *in, size_t inStride, T *out, size_t outStride, size_t count,
+				const std::vector<T> &table)
+{
+	ConverterInstruments::Timer timer(STATS_DECODE);
+	
+	// every bit pattern has an entry, so no clamping
+	const T *lut = &table[0];
+	
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = lut[ in[0].bits() ];
+		out[1] = lut[ in[1].bits() ];
+		out[2] = lut[ in[2].bits() ];
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+static inline float
+NoCurve(float in)
+{
+	return in;
+}
+
+
+static inline float
+HalfValue(unsigned int bits)
+{
+	half h;
+	h.setBits(bits);
+	
+	return h;
+}
+
+
+template <float CURVE(float)>
+static void
+CurveTables(std::vector<float> &table8, std::vector<float> &table16)
+{
+	table8.resize(DCIconverterBase::MAX_CHAN8 + 1);
+	table16.resize(DCIconverterBase::MAX_CHAN16 + 1);
+	
+	// same int to float conversion as IntToFloatSpan
+	for(unsigned int i=0; i < table8.size(); i++)
+		table8[i] = CURVE((float)i / (float)DCIconverterBase::MAX_CHAN8);
+	
+	for(unsigned int i=0; i < table16.size(); i++)
+		table16[i] = CURVE((float)i / (float)DCIconverterBase::MAX_CHAN16);
+}
+
+
+static void
+GammaTables(std::vector<float> &table8, std::vector<float> &table16, float gamma)
+{
+	table8.resize(DCIconverterBase::MAX_CHAN8 + 1);
+	table16.resize(DCIconverterBase::MAX_CHAN16 + 1);
+	
+	for(unsigned int i=0; i < table8.size(); i++)
+		table8[i] = GammaFunc((float)i / (float)DCIconverterBase::MAX_CHAN8, gamma);
+	
+	for(unsigned int i=0; i < table16.size(); i++)
+		table16[i] = GammaFunc((float)i / (float)DCIconverterBase::MAX_CHAN16, gamma);
+}
+
+
+// Same for half input, indexed by bit pattern
+template <float CURVE(float)>
+static void
+HalfCurveTable(std::vector<float> &table)
+{
+	table.resize(DCIconverterBase::HALF_VALUES);
+	
+	for(unsigned int i=0; i < table.size(); i++)
+		table[i] = CURVE( HalfValue(i) );
+}
+
+
+static void
+HalfGammaTable(std::vector<float> &table, float gamma)
+{
+	table.resize(DCIconverterBase::HALF_VALUES);
+	
+	for(unsigned int i=0; i < table.size(); i++)
+		table[i] = GammaFunc(HalfValue(i), gamma);
+}
+
+
+DCDMencoder::DCDMencoder(float xyz_gamma)
+{
+	// Code c covers linear values from ((c - 0.5) / 4095)^gamma up to the next
+	// code's threshold.  The last one is infinity so searches always stop.
+	_thresholds.resize(MAX_CODE + 2);
+	
+	_thresholds[0] = 0.f;
+	
+	for(int c=1; c <= MAX_CODE; c++)
+		_thresholds[c] = pow(((double)c - 0.5) / (double)MAX_CODE, (double)xyz_gamma);
+	
+	_thresholds[MAX_CODE + 1] = std::numeric_limits<float>::infinity();
+	
+	
+	// Anything below the first octave that can reach code 1 is code 0
+	int min_exponent = (int)floor( log(_thresholds[1]) / log(2.0) );
+	
+	if(min_exponent < -126)
+		min_exponent = -126;
+	else if(min_exponent > -1)
+		min_exponent = -1;
+	
+	_min_bits = (unsigned int)(127 + min_exponent) << 23;
+	
+	
+	// The table is indexed by the top bits of the float, so every octave
+	// gets the same number of entries.  Each entry is the code at the bottom
+	// of its cell; encode() steps up if the value crosses a threshold.
+	const unsigned int entries = ((unsigned int)(-min_exponent) << INDEX_BITS) + 1; // the +1 is 1.0 exactly
+	
+	_table.resize(entries);
+	
+	unsigned int code = 0;
+	
+	for(unsigned int i=0; i < entries; i++)
+	{
+		const unsigned int bits = _min_bits + (i << (23 - INDEX_BITS));
+		
+		float value;
+		memcpy(&value, &bits, sizeof(float));
+		
+		while(value >= _thresholds[code + 1])
+			code++;
+		
+		_table[i] = code;
+	}
+	
+	_one_step = true;
+	
+	for(unsigned int i=1; i < entries; i++)
+	{
+		if(_table[i] - _table[i - 1] > 1)
+			_one_step = false;
+	}
+}
+
+
+inline unsigned short
+DCDMencoder::encode(float xyz, bool one_step) const
+{
+	// clamp, NaN goes to 0
+	xyz = (xyz > 0.f ? (xyz < 1.f ? xyz : 1.f) : 0.f);
+	
+	unsigned int bits;
+	memcpy(&bits, &xyz, sizeof(float));
+	
+	// anything under the table's first octave lands in entry 0, which is code 0
+	bits = (bits > _min_bits ? bits : _min_bits);
+	
+	unsigned int code = _table[(bits - _min_bits) >> (23 - INDEX_BITS)];
+	
+	// A cell holds at most one threshold unless the X'Y'Z' gamma is very low,
+	// so one branch-free step is all the usual case needs.
+	code += (xyz >= _thresholds[code + 1]);
+	
+	if(!one_step)
+	{
+		while(xyz >= _thresholds[code + 1])
+			code++;
+	}
+	
+	return code;
+}
+
+
+void
+DCDMencoder::encodeSpan(const float *in, size_t inStride, unsigned short *out, size_t outStride, size_t count) const
+{
+	ConverterInstruments::Timer timer(STATS_ENCODE);
+	
+	if(_one_step)
+	{
+		for(size_t i=0; i < count; i++)
+		{
+			out[0] = encode(in[0], true);
+			out[1] = encode(in[1], true);
+			out[2] = encode(in[2], true);
+			
+			in += inStride;
+			out += outStride;
+		}
+	}
+	else
+	{
+		for(size_t i=0; i < count; i++)
+		{
+			out[0] = encode(in[0], false);
+			out[1] = encode(in[1], false);
+			out[2] = encode(in[2], false);
+			
+			in += inStride;
+			out += outStride;
+		}
+	}
+}
+
+
+void
+HalfEncoder::Samples(std::vector<float> &samples)
+{
+	// every half value, then every half value scaled down for the low table
+	const float low_scale = 1.f / (float)(1 << LOW_SHIFT);
+	
+	samples.assign(((2 * DCIconverterBase::HALF_VALUES + 2) / 3) * 3, 0.f);
+	
+	for(unsigned int i=0; i < DCIconverterBase::HALF_VALUES; i++)
+	{
+		samples[i] = HalfValue(i);
+		samples[DCIconverterBase::HALF_VALUES + i] = HalfValue(i) * low_scale;
+	}
+}
+
+
+void
+HalfEncoder::init(const std::vector<float> &encoded)
+{
+	assert(encoded.size() >= 2 * DCIconverterBase::HALF_VALUES);
+	
+	_table.resize(DCIconverterBase::HALF_VALUES);
+	_low.resize(DCIconverterBase::HALF_VALUES);
+	
+	DCIfloatToHalf(&encoded[0], &_table[0], _table.size());
+	DCIfloatToHalf(&encoded[DCIconverterBase::HALF_VALUES], &_low[0], _low.size());
+}
+
+
+void
+HalfEncoder::encodeSpan(const float *in, half *out, size_t outStride, size_t count) const
+{
+	ConverterInstruments::Timer timer(STATS_ENCODE);
+	
+	const float low_scale = (float)(1 << LOW_SHIFT);
+	
+	const half *table = &_table[0];
+	const half *low = &_low[0];
+	
+	const size_t block_size = 256;
+	
+	half key[block_size * 3];
+	
+	for(size_t done=0; done < count; done += block_size)
+	{
+		const size_t n = (count - done < block_size ? count - done : block_size);
+		
+		DCIfloatToHalf(in, key, n * 3);
+		
+		for(size_t i=0; i < n; i++)
+		{
+			for(int c=0; c < 3; c++)
+			{
+				const unsigned short bits = key[(i * 3) + c].bits();
+				
+				// a zero exponent is a denormal or a value that rounded to zero
+				if((bits & 0x7c00) != 0 || in[c] == 0.f)
+					out[c] = table[bits];
+				else
+					out[c] = low[ half(in[c] * low_scale).bits() ];
+			}
+			
+			in += 3;
+			out += outStride;
+		}
+	}
+}
+
+
+FixedPointPipeline::FixedPointPipeline()
+{
+	memset(_matrix, 0, sizeof(_matrix));
+}
+
+
+static inline int
+HighBit(unsigned long long val)
+{
+#if defined(__GNUC__)
+	return 63 - __builtin_clzll(val);
+#elif defined(_MSC_VER)
+	unsigned long index;
+	_BitScanReverse64(&index, val);
+	return index;
+#else
+	int bit = 0;
+	
+	while(val >>= 1)
+		bit++;
+	
+	return bit;
+#endif
+}
+
+
+// Encode table index of a fixed-point linear value.  Values below
+// 2^(ENCODE_BITS + 1) index the table directly, above that every octave gets
+// 2^ENCODE_BITS entries and shift is how many low bits were dropped, which
+// the caller interpolates with.
+static inline unsigned int
+EncodeIndex(unsigned long long linear, int &shift)
+{
+	if(linear < (2u << FixedPointPipeline::ENCODE_BITS))
+	{
+		shift = 0;
+		
+		return linear;
+	}
+	
+	shift = HighBit(linear) - FixedPointPipeline::ENCODE_BITS;
+	
+	return (shift << FixedPointPipeline::ENCODE_BITS) + (unsigned int)(linear >> shift);
+}
+
+
+void
+FixedPointPipeline::EncodeNodes(std::vector<float> &nodes)
+{
+	int shift;
+	
+	// One more than the index of 1.0, which interpolation reads past, and then
+	// rounded up to whole triples so the converters can use their span functions.
+	const unsigned int entries = (((EncodeIndex(1ULL << MIXED_BITS, shift) + 2) + 2) / 3) * 3;
+	
+	nodes.resize(entries);
+	
+	for(unsigned int i=0; i < entries; i++)
+	{
+		const int octave = i >> ENCODE_BITS;
+		const int node_shift = (octave > 0 ? octave - 1 : 0);
+		const unsigned long long linear = (unsigned long long)(i - (node_shift << ENCODE_BITS)) << node_shift;
+		
+		nodes[i] = (double)linear / (double)(1ULL << MIXED_BITS);
+	}
+}
+
+
+static void
+FixedTable(const std::vector<float> &table, std::vector<int> &fixed, double scale, double max)
+{
+	fixed.resize( table.size() );
+	
+	for(unsigned int i=0; i < table.size(); i++)
+	{
+		const double val = (table[i] >= 1.f ? 1.0 : table[i] <= 0.f ? 0.0 : table[i]);
+		
+		fixed[i] = (int)( (val * max * scale) + 0.5 );
+	}
+}
+
+
+void
+FixedPointPipeline::init(const std::vector<float> &decode8, const std::vector<float> &decode16,
+							const Imath::M33f &matrix, const std::vector<float> &encoded)
+{
+	FixedTable(decode8, _decode8, 1u << LINEAR_BITS, 1.0);
+	FixedTable(decode16, _decode16, 1u << LINEAR_BITS, 1.0);
+	
+	for(int i=0; i < 3; i++)
+	{
+		for(int j=0; j < 3; j++)
+		{
+			const double coeff = (double)matrix[i][j] * (double)(1u << MATRIX_BITS);
+			
+			_matrix[i][j] = (int)(coeff >= 0.0 ? coeff + 0.5 : coeff - 0.5);
+		}
+	}
+	
+	// each output is three 2.30 values times 4.28 coefficients, which has to fit in a long long
+	for(int j=0; j < 3; j++)
+		assert(fabs(matrix[0][j]) + fabs(matrix[1][j]) + fabs(matrix[2][j]) < 8.0);
+	
+	FixedTable(encoded, _encode8, 1u << CODE_BITS, DCIconverterBase::MAX_CHAN8);
+	FixedTable(encoded, _encode16, 1u << CODE_BITS, DCIconverterBase::MAX_CHAN16);
+}
+
+
+static inline int
+FixedEncode(long long sum, const int *encode)
+{
+	// down to MIXED_BITS, clamped to 0-1
+	const int drop = FixedPointPipeline::LINEAR_BITS + FixedPointPipeline::MATRIX_BITS - FixedPointPipeline::MIXED_BITS;
+	
+	const long long one = 1LL << FixedPointPipeline::MIXED_BITS;
+	const long long rounded = (sum + (1LL << (drop - 1))) >> drop;
+	const unsigned long long linear = (unsigned long long)(rounded <= 0 ? 0 : rounded >= one ? one : rounded);
+	
+	int shift;
+	const unsigned int index = EncodeIndex(linear, shift);
+	
+	const int lo = encode[index];
+	const int hi = encode[index + 1];
+	const long long frac = (long long)(linear & ((1ULL << shift) - 1));
+	
+	const int code = lo + (int)( ((long long)(hi - lo) * frac) >> shift );
+	
+	return (code + (1 << (FixedPointPipeline::CODE_BITS - 1))) >> FixedPointPipeline::CODE_BITS;
+}
+
+
+template <typename T>
+void
+FixedPointPipeline::convert(const T *in, size_t inStride, T *out, size_t outStride, size_t count,
+							const std::vector<int> &decode, const std::vector<int> &encode) const
+{
+	ConverterInstruments::Timer timer(STATS_FIXED);
+	
+	ConverterInstruments::CountPixels(count);
+	
+	const int *dec = &decode[0];
+	const int *enc = &encode[0];
+	
+	const unsigned int max = decode.size() - 1;
+	
+	for(size_t i=0; i < count; i++)
+	{
+		const long long r = dec[ in[0] < max ? in[0] : max ];
+		const long long g = dec[ in[1] < max ? in[1] : max ];
+		const long long b = dec[ in[2] < max ? in[2] : max ];
+		
+		// read everything before writing so in and out can be the same
+		const int x = FixedEncode(r * _matrix[0][0] + g * _matrix[1][0] + b * _matrix[2][0], enc);
+		const int y = FixedEncode(r * _matrix[0][1] + g * _matrix[1][1] + b * _matrix[2][1], enc);
+		const int z = FixedEncode(r * _matrix[0][2] + g * _matrix[1][2] + b * _matrix[2][2], enc);
+		
+		out[0] = x;
+		out[1] = y;
+		out[2] = z;
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+void
+FixedPointPipeline::convertSpan(const unsigned char *in, unsigned char *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	convert(in, inStride, out, outStride, count, _decode8, _encode8);
+}
+
+
+void
+FixedPointPipeline::convertSpan(const unsigned short *in, unsigned short *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	convert(in, inStride, out, outStride, count, _decode16, _encode16);
+}
+
+
+ForwardDCIconverter::ForwardDCIconverter(ResponseCurve curve, float gamma,
+											ColorSpace color, ChromaticAdaptation adapt, int temperature,
+											bool normalize, float xyz_gamma, Precision precision) :
+	DCIconverterBase(color, adapt, temperature),
+	_curve(curve),
+	_gamma(gamma),
+	_xyz_gamma(xyz_gamma),
+	_normalize(normalize),
+	_precision(precision),
+	_rgb2xyz_matrix( DCIconverterBase::_rgb2xyz_matrix ),
+	_dcdm_encoder(xyz_gamma)
+{
+	// Tables for integer input, indexed by code value
+	switch(_curve)
+	{
+		case sRGB:			CurveTables<sRGBtoLin>(_linearize8, _linearize16);			break;
+		case Rec709:		CurveTables<Rec709toLin>(_linearize8, _linearize16);		break;
+		case ProPhotoRGB:	CurveTables<ProPhotoRGBtoLin>(_linearize8, _linearize16);	break;
+		case P3:			GammaTables(_linearize8, _linearize16, 2.6f);				break;
+		case Gamma:			GammaTables(_linearize8, _linearize16, _gamma);				break;
+		default:
+			assert(_curve == Linear);
+			CurveTables<NoCurve>(_linearize8, _linearize16);
+	}
+	
+	
+	// Exact keeps 8 and 16-bit conversions in float, so the fixed-point
+	// pipeline is only worth building below it
+	if(_precision != Exact)
+	{
+		std::vector<float> encoded;
+		FixedPointPipeline::EncodeNodes(encoded);
+		
+		GammaSpan(&encoded[0], 3, &encoded[0], 3, encoded.size() / 3, 1.f / _xyz_gamma);
+		
+		const float scale = (_normalize ? 48.f / 52.37f : 1.f);
+		
+		_fixed.init(_linearize8, _linearize16, _rgb2xyz_matrix * scale, encoded);
+	}
+}
+
+
+Pixel
+ForwardDCIconverter::convert(const Pixel &pix) const
+{
+	Pixel rgb = pix;
+	
+	float &r = rgb[0];
+	float &g = rgb[1];
+	float &b = rgb[2];
+	
+	
+	// Video RGB to linear RGB (R'G'B' to RGB)
+	if(_curve == sRGB)
+	{
+		r = sRGBtoLin(r);
+		g = sRGBtoLin(g);
+		b = sRGBtoLin(b);
+	}
+	else if(_curve == Rec709)
+	{
+		r = Rec709toLin(r);
+		g = Rec709toLin(g);
+		b = Rec709toLin(b);
+	}
+	else if(_curve == ProPhotoRGB)
+	{
+		r = ProPhotoRGBtoLin(r);
+		g = ProPhotoRGBtoLin(g);
+		b = ProPhotoRGBtoLin(b);
+	}
+	else if(_curve == P3)
+	{
+		r = GammaFunc(r, 2.6f);
+		g = GammaFunc(g, 2.6f);
+		b = GammaFunc(b, 2.6f);
+	}
+	else if(_curve == Gamma)
+	{
+		r = GammaFunc(r, _gamma);
+		g = GammaFunc(g, _gamma);
+		b = GammaFunc(b, _gamma);
+	}
+	else
+	{
+		assert(_curve == Linear);
+	}
+
+	
+	// Convert to XYZ
+	Pixel xyz = rgb * _rgb2xyz_matrix;
+	
+	
+	// normalize
+	if(_normalize)
+	{
+		xyz.x *= 48.f / 52.37f;
+		xyz.y *= 48.f / 52.37f;
+		xyz.z *= 48.f / 52.37f;
+	}
+	
+	
+	// XYZ to X'Y'Z'
+	xyz.x = GammaFunc(xyz.x, 1.f / _xyz_gamma);
+	xyz.y = GammaFunc(xyz.y, 1.f / _xyz_gamma);
+	xyz.z = GammaFunc(xyz.z, 1.f / _xyz_gamma);
+	
+	
+	return xyz;
+}
+
+
+bool
+ForwardDCIconverter::kernelParams(DCIkernelParams &params) const
+{
+	params.forward = true;
+	params.curve = _curve;
+	params.gamma = (_curve == P3 ? 2.6f : _gamma);
+	params.scale = (_normalize ? 48.f / 52.37f : 1.f);
+	params.xyz_gamma = 1.f / _xyz_gamma;
+	params.precision = _precision;
+	
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
+			params.matrix[i][j] = _rgb2xyz_matrix[i][j];
+	
+	return true;
+}
+
+
+void
+ForwardDCIconverter::convertSpan(const float *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	convertFloatSpan(in, out, count, inStride, outStride, false, true);
+}
+
+
+void
+ForwardDCIconverter::convertSpan(const unsigned char *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	TableSpan(in, inStride, out, outStride, count, _linearize8);
+	
+	convertFloatSpan(out, out, count, outStride, outStride, true, true);
+}
+
+
+void
+ForwardDCIconverter::convertSpan(const unsigned short *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	TableSpan(in, inStride, out, outStride, count, _linearize16);
+	
+	convertFloatSpan(out, out, count, outStride, outStride, true, true);
+}
+
+
+void
+ForwardDCIconverter::convertSpan(const unsigned char *in, unsigned char *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	// the fixed-point pipeline can be a code or so off, so only below Exact
+	if(_precision == Exact)
+	{
+		DCIconverterBase::convertSpan(in, out, count, inStride, outStride);
+	}
+	else
+	{
+		assert(_fixed.initialized());
+		_fixed.convertSpan(in, out, count, inStride, outStride);
+	}
+}
+
+
+void
+ForwardDCIconverter::convertSpan(const unsigned short *in, unsigned short *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	// the fixed-point pipeline can be a code or so off, so only below Exact
+	if(_precision == Exact)
+	{
+		DCIconverterBase::convertSpan(in, out, count, inStride, outStride);
+	}
+	else
+	{
+		assert(_fixed.initialized());
+		_fixed.convertSpan(in, out, count, inStride, outStride);
+	}
+}
+
+
+void
+ForwardDCIconverter::initHalf() const
+{
+	switch(_curve)
+	{
+		case sRGB:			HalfCurveTable<sRGBtoLin>(_linearizeHalf);			break;
+		case Rec709:		HalfCurveTable<Rec709toLin>(_linearizeHalf);		break;
+		case ProPhotoRGB:	HalfCurveTable<ProPhotoRGBtoLin>(_linearizeHalf);	break;
+		case P3:			HalfGammaTable(_linearizeHalf, 2.6f);				break;
+		case Gamma:			HalfGammaTable(_linearizeHalf, _gamma);				break;
+		default:
+			assert(_curve == Linear);
+			HalfCurveTable<NoCurve>(_linearizeHalf);
+	}
+	
+	std::vector<float> samples;
+	HalfEncoder::Samples(samples);
+	
+	GammaSpan(&samples[0], 3, &samples[0], 3, samples.size() / 3, 1.f / _xyz_gamma);
+	
+	_half_encoder.init(samples);
+}
+
+
+void
+ForwardDCIconverter::convertSpan(const half *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	std::call_once(_half_once, &ForwardDCIconverter::initHalf, this);
+	
+	HalfTableSpan(in, inStride, out, outStride, count, _linearizeHalf);
+	
+	convertFloatSpan(out, out, count, outStride, outStride, true, true);
+}
+
+
+void
+ForwardDCIconverter::convertSpan(const half *in, half *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	std::call_once(_half_once, &ForwardDCIconverter::initHalf, this);
+	
+	// normalized linear XYZ a block at a time, so in and out can be the same
+	const size_t block_size = 256;
+	
+	float buf[block_size * 3];
+	
+	for(size_t done=0; done < count; done += block_size)
+	{
+		const size_t n = (count - done < block_size ? count - done : block_size);
+		
+		HalfTableSpan(in + (done * inStride), inStride, buf, 3, n, _linearizeHalf);
+		
+		convertFloatSpan(buf, buf, n, 3, 3, true, false);
+		
+		_half_encoder.encodeSpan(buf, out + (done * outStride), outStride, n);
+	}
+}
+
+
+void
+ForwardDCIconverter::convertFloatSpan(const float *in, float *out, size_t count,
+										size_t inStride, size_t outStride,
+										bool linearized, bool encode) const
+{
+	DCIkernelParams params;
+	
+	kernelParams(params);
+	
+	if(linearized)
+		params.curve = Linear;
+	
+	if(!encode)
+		params.xyz_gamma = 1.f;
+	
+	DCIplan plan;
+	
+	DCIlowerPlan(params, plan);
+	
+	if( DCIplanConvertSpan(plan, in, out, count, inStride, outStride) )
+	{
+		ConverterInstruments::CountOutput(out, count, outStride);
+		return;
+	}
+	
+	
+	BlockStages stages = { NULL, plan.params.gamma, plan.params.matrix, NULL, plan.params.xyz_gamma };
+	
+	switch(plan.params.curve)
+	{
+		case sRGB:			stages.before = CurvePlane<sRGBtoLin>;			break;
+		case Rec709:		stages.before = CurvePlane<Rec709toLin>;		break;
+		case ProPhotoRGB:	stages.before = CurvePlane<ProPhotoRGBtoLin>;	break;
+		case P3:
+		case Gamma:			stages.before = GammaPlane;						break;
+		default:
+			assert(plan.params.curve == Linear);
+	}
+	
+	if(plan.stages & DCI_STAGE_XYZ_GAMMA)
+		stages.after = GammaPlane;
+	
+	BlockedSpan(in, inStride, out, outStride, count, stages);
+	
+	ConverterInstruments::CountOutput(out, count, outStride);
+}
+
+
+template <typename T>
+void
+ForwardDCIconverter::convertDCDMSpan(const T *in, unsigned short *out, size_t count,
+										size_t inStride, size_t outStride) const
+{
+	// go to normalized linear XYZ a block at a time, then encode from the table
+	const size_t block_size = 256;
+	
+	float buf[block_size * 3];
+	
+	while(count > 0)
+	{
+		const size_t n = (count < block_size ? count : block_size);
+		
+		linearXYZSpan(in, buf, n, inStride);
+		
+		_dcdm_encoder.encodeSpan(buf, 3, out, outStride, n);
+		
+		in += n * inStride;
+		out += n * outStride;
+		count -= n;
+	}
+}
+
+
+void
+ForwardDCIconverter::linearXYZSpan(const float *in, float *out, size_t count, size_t inStride) const
+{
+	convertFloatSpan(in, out, count, inStride, 3, false, false);
+}
+
+
+void
+ForwardDCIconverter::linearXYZSpan(const unsigned char *in, float *out, size_t count, size_t inStride) const
+{
+	TableSpan(in, inStride, out, 3, count, _linearize8);
+	
+	convertFloatSpan(out, out, count, 3, 3, true, false);
+}
+
+
+void
+ForwardDCIconverter::linearXYZSpan(const unsigned short *in, float *out, size_t count, size_t inStride) const
+{
+	TableSpan(in, inStride, out, 3, count, _linearize16);
+	
+	convertFloatSpan(out, out, count, 3, 3, true, false);
+}
+
+
+void
+ForwardDCIconverter::convertSpanDCDM(const float *in, unsigned short *out, size_t count,
+										size_t inStride, size_t outStride) const
+{
+	convertDCDMSpan(in, out, count, inStride, outStride);
+}
+
+
+void
+ForwardDCIconverter::convertSpanDCDM(const unsigned char *in, unsigned short *out, size_t count,
+										size_t inStride, size_t outStride) const
+{
+	convertDCDMSpan(in, out, count, inStride, outStride);
+}
+
+
+void
+ForwardDCIconverter::convertSpanDCDM(const unsigned short *in, unsigned short *out, size_t count,
+										size_t inStride, size_t outStride) const
+{
+	convertDCDMSpan(in, out, count, inStride, outStride);
+}
+
+
+void
+ForwardDCIconverter::convertPlanar(const float *const in[3], float *const out[3], size_t count,
+									size_t inStride, size_t outStride) const
+{
+	DCIkernelParams params;
+	
+	kernelParams(params);
+	
+	DCIplan plan;
+	
+	DCIlowerPlan(params, plan);
+	
+	if( DCIplanConvertPlanar(plan, in, out, count, inStride, outStride) )
+	{
+		ConverterInstruments::CountOutput(out, count, outStride);
+		return;
+	}
+	
+	// counted by convertSpan()
+	DCIconverterBase::convertPlanar(in, out, count, inStride, outStride);
+}
+
+
+inline float
+ForwardDCIconverter::sRGBtoLin(float in)
+{
+	// sRGB to linear transfer function
+	// http://en.wikipedia.org/wiki/SRGB
+	// http://www.color.org/chardata/rgb/srgb.xalter
+	
+	return (in <= 0.04045f ? (in / 12.92f) : powf( (in + 0.055f) / 1.055f, 2.4f));
+}
+
+
+inline float
+ForwardDCIconverter::Rec709toLin(float in)
+{
+	// Rec. 709 to linear transfer function
+	// http://en.wikipedia.org/wiki/Rec._709
+	// http://www.poynton.com/notes/colour_and_gamma/GammaFAQ.html#gamma_correction
+	
+	return (in <= 0.081f ? (in / 4.5f) : powf( (in + 0.099f) / 1.099f, 1.0f / 0.45f));
+}
+
+
+inline float
+ForwardDCIconverter::ProPhotoRGBtoLin(float in)
+{
+	// ProPhotoRGB to linear transfer function.  Inverse of LinToProPhotoRGB spec.
+	// http://en.wikipedia.org/wiki/ProPhoto_RGB_color_space
+	// http://www.color.org/ROMMRGB.pdf
+	
+	return (in < 0.031248f ? (in / 16.f) : powf(in, 1.8f));
 }
 
 
 ReverseDCIconverter::ReverseDCIconverter(ResponseCurve curve, float gamma,
 											ColorSpace color, ChromaticAdaptation adapt, int temperature,
-											bool normalize, float xyz_gamma) :
+											bool normalize, float xyz_gamma, Precision precision) :
 	DCIconverterBase(color, adapt, temperature),
 	_curve(curve),
 	_gamma(gamma),
-	_normalize(normalize),
 	_xyz_gamma(xyz_gamma),
+	_normalize(normalize),
+	_precision(precision),
 	_xyz2rgb_matrix( DCIconverterBase::_rgb2xyz_matrix.inverse() )
 {
-
+	// Tables for integer input, indexed by code value
+	GammaTables(_decode8, _decode16, _xyz_gamma);
+	
+	
+	// Exact keeps 8 and 16-bit conversions in float, so the fixed-point
+	// pipeline is only worth building below it
+	if(_precision != Exact)
+	{
+		std::vector<float> encoded;
+		FixedPointPipeline::EncodeNodes(encoded);
+		
+		curveSpan(&encoded[0], encoded.size() / 3, 3);
+		
+		const float scale = (_normalize ? 52.37f / 48.f : 1.f);
+		
+		_fixed.init(_decode8, _decode16, _xyz2rgb_matrix * scale, encoded);
+	}
 }
 
 
@@ -515,6 +1887,245 @@ ReverseDCIconverter::convert(const Pixel &pix) const
 }
 
 
+bool
+ReverseDCIconverter::kernelParams(DCIkernelParams &params) const
+{
+	params.forward = false;
+	params.curve = _curve;
+	params.gamma = (_curve == P3 ? 1.f / 2.6f : 1.f / _gamma);
+	params.scale = (_normalize ? 52.37f / 48.f : 1.f);
+	params.xyz_gamma = _xyz_gamma;
+	params.precision = _precision;
+	
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
+			params.matrix[i][j] = _xyz2rgb_matrix[i][j];
+	
+	return true;
+}
+
+
+void
+ReverseDCIconverter::convertSpan(const float *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	DCIkernelParams params;
+	
+	kernelParams(params);
+	
+	DCIplan plan;
+	
+	DCIlowerPlan(params, plan);
+	
+	if( DCIplanConvertSpan(plan, in, out, count, inStride, outStride) )
+	{
+		ConverterInstruments::CountOutput(out, count, outStride);
+		return;
+	}
+	
+	
+	convertBlocked(plan, in, out, count, inStride, outStride);
+	
+	ConverterInstruments::CountOutput(out, count, outStride);
+}
+
+
+void
+ReverseDCIconverter::convertSpan(const unsigned char *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	TableSpan(in, inStride, out, outStride, count, _decode8);
+	
+	convertDecodedSpan(out, count, outStride);
+}
+
+
+void
+ReverseDCIconverter::convertSpan(const unsigned short *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	TableSpan(in, inStride, out, outStride, count, _decode16);
+	
+	convertDecodedSpan(out, count, outStride);
+}
+
+
+void
+ReverseDCIconverter::convertSpan(const unsigned char *in, unsigned char *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	// the fixed-point pipeline can be a code or so off, so only below Exact
+	if(_precision == Exact)
+	{
+		DCIconverterBase::convertSpan(in, out, count, inStride, outStride);
+	}
+	else
+	{
+		assert(_fixed.initialized());
+		_fixed.convertSpan(in, out, count, inStride, outStride);
+	}
+}
+
+
+void
+ReverseDCIconverter::convertSpan(const unsigned short *in, unsigned short *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	// the fixed-point pipeline can be a code or so off, so only below Exact
+	if(_precision == Exact)
+	{
+		DCIconverterBase::convertSpan(in, out, count, inStride, outStride);
+	}
+	else
+	{
+		assert(_fixed.initialized());
+		_fixed.convertSpan(in, out, count, inStride, outStride);
+	}
+}
+
+
+void
+ReverseDCIconverter::initHalf() const
+{
+	HalfGammaTable(_decodeHalf, _xyz_gamma);
+	
+	std::vector<float> samples;
+	HalfEncoder::Samples(samples);
+	
+	curveSpan(&samples[0], samples.size() / 3, 3);
+	
+	_half_encoder.init(samples);
+}
+
+
+void
+ReverseDCIconverter::convertSpan(const half *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	std::call_once(_half_once, &ReverseDCIconverter::initHalf, this);
+	
+	HalfTableSpan(in, inStride, out, outStride, count, _decodeHalf);
+	
+	convertDecodedSpan(out, count, outStride);
+}
+
+
+void
+ReverseDCIconverter::convertSpan(const half *in, half *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	std::call_once(_half_once, &ReverseDCIconverter::initHalf, this);
+	
+	// linear RGB a block at a time, so in and out can be the same
+	const size_t block_size = 256;
+	
+	float buf[block_size * 3];
+	
+	for(size_t done=0; done < count; done += block_size)
+	{
+		const size_t n = (count - done < block_size ? count - done : block_size);
+		
+		HalfTableSpan(in + (done * inStride), inStride, buf, 3, n, _decodeHalf);
+		
+		convertDecodedSpan(buf, n, 3, false);
+		
+		_half_encoder.encodeSpan(buf, out + (done * outStride), outStride, n);
+	}
+}
+
+
+void
+ReverseDCIconverter::convertDecodedSpan(float *buf, size_t count, size_t stride, bool curve) const
+{
+	DCIkernelParams params;
+	
+	kernelParams(params);
+	
+	params.xyz_gamma = 1.f;
+	
+	if(!curve)
+		params.curve = Linear;
+	
+	DCIplan plan;
+	
+	DCIlowerPlan(params, plan);
+	
+	if( DCIplanConvertSpan(plan, buf, buf, count, stride, stride) )
+	{
+		ConverterInstruments::CountOutput(buf, count, stride);
+		return;
+	}
+	
+	
+	convertBlocked(plan, buf, buf, count, stride, stride);
+	
+	ConverterInstruments::CountOutput(buf, count, stride);
+}
+
+
+void
+ReverseDCIconverter::convertBlocked(const DCIplan &plan, const float *in, float *out, size_t count,
+									size_t inStride, size_t outStride) const
+{
+	BlockStages stages = { NULL, plan.params.xyz_gamma, plan.params.matrix, NULL, plan.params.gamma };
+	
+	if(plan.stages & DCI_STAGE_XYZ_GAMMA)
+		stages.before = GammaPlane;
+	
+	switch(plan.params.curve)
+	{
+		case sRGB:			stages.after = CurvePlane<LinTosRGB>;			break;
+		case Rec709:		stages.after = CurvePlane<LinToRec709>;			break;
+		case ProPhotoRGB:	stages.after = CurvePlane<LinToProPhotoRGB>;	break;
+		case P3:
+		case Gamma:			stages.after = GammaPlane;						break;
+		default:
+			assert(plan.params.curve == Linear);
+	}
+	
+	BlockedSpan(in, inStride, out, outStride, count, stages);
+}
+
+
+void
+ReverseDCIconverter::curveSpan(float *buf, size_t count, size_t stride) const
+{
+	switch(_curve)
+	{
+		case sRGB:			CurveSpan<LinTosRGB>(buf, stride, buf, stride, count);			break;
+		case Rec709:		CurveSpan<LinToRec709>(buf, stride, buf, stride, count);		break;
+		case ProPhotoRGB:	CurveSpan<LinToProPhotoRGB>(buf, stride, buf, stride, count);	break;
+		case P3:			GammaSpan(buf, stride, buf, stride, count, 1.f / 2.6f);			break;
+		case Gamma:			GammaSpan(buf, stride, buf, stride, count, 1.f / _gamma);		break;
+		default:
+			assert(_curve == Linear);
+	}
+}
+
+
+void
+ReverseDCIconverter::convertPlanar(const float *const in[3], float *const out[3], size_t count,
+									size_t inStride, size_t outStride) const
+{
+	DCIkernelParams params;
+	
+	kernelParams(params);
+	
+	DCIplan plan;
+	
+	DCIlowerPlan(params, plan);
+	
+	if( DCIplanConvertPlanar(plan, in, out, count, inStride, outStride) )
+	{
+		ConverterInstruments::CountOutput(out, count, outStride);
+		return;
+	}
+	
+	// counted by convertSpan()
+	DCIconverterBase::convertPlanar(in, out, count, inStride, outStride);
+}
+
+
 inline float
 ReverseDCIconverter::LinTosRGB(float in)
 {
@@ -541,3 +2152,190 @@ ReverseDCIconverter::LinToProPhotoRGB(float in)
 	return (in < 0.001953f ? (in * 16.f) : powf(in, 1.f / 1.8f));
 }
 
+
+
+// Converters with the curve and unit X'Y'Z' gamma decided at compile time.
+// The switches and ifs below are all on template parameters, so each
+// instantiation's per-pixel code is straight-line.  Normalization is folded
+// into the matrix the same way DCIlowerPlan() does it for the kernels, so
+// results match the general convert() to within a rounding.  Spans go
+// through the base classes, which run the plan's kernel or, without one,
+// the same stages a block at a time.
+
+template <DCIconverterBase::ResponseCurve CURVE, bool UNIT_XYZ>
+class SpecializedForwardDCIconverter : public ForwardDCIconverter
+{
+  public:
+	SpecializedForwardDCIconverter(ResponseCurve curve, float gamma,
+									ColorSpace color, ChromaticAdaptation adapt, int temperature,
+									bool normalize, float xyz_gamma, Precision precision) :
+		ForwardDCIconverter(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision),
+		_matrix(_rgb2xyz_matrix * (normalize ? 48.f / 52.37f : 1.f)),
+		_xyz_encode(1.f / xyz_gamma)
+	{
+		assert(curve == CURVE && (xyz_gamma == 1.f) == UNIT_XYZ);
+	}
+	
+	virtual Pixel convert(const Pixel &pix) const
+	{
+		Pixel out;
+		
+		convertPixel(&pix[0], &out[0]);
+		
+		return out;
+	}
+	
+  private:
+	const Matrix _matrix;
+	const float _xyz_encode;
+	
+	inline float linearize(float in) const
+	{
+		switch(CURVE)
+		{
+			case sRGB:			return sRGBtoLin(in);
+			case Rec709:		return Rec709toLin(in);
+			case ProPhotoRGB:	return ProPhotoRGBtoLin(in);
+			case P3:			return GammaFunc(in, 2.6f);
+			case Gamma:			return GammaFunc(in, _gamma);
+			default:			return in;
+		}
+	}
+	
+	inline void convertPixel(const float *in, float *out) const
+	{
+		const Matrix &m = _matrix;
+		
+		const float r = linearize(in[0]);
+		const float g = linearize(in[1]);
+		const float b = linearize(in[2]);
+		
+		float x = r * m[0][0] + g * m[1][0] + b * m[2][0];
+		float y = r * m[0][1] + g * m[1][1] + b * m[2][1];
+		float z = r * m[0][2] + g * m[1][2] + b * m[2][2];
+		
+		if(!UNIT_XYZ)
+		{
+			x = GammaFunc(x, _xyz_encode);
+			y = GammaFunc(y, _xyz_encode);
+			z = GammaFunc(z, _xyz_encode);
+		}
+		
+		out[0] = x;
+		out[1] = y;
+		out[2] = z;
+	}
+};
+
+
+template <DCIconverterBase::ResponseCurve CURVE, bool UNIT_XYZ>
+class SpecializedReverseDCIconverter : public ReverseDCIconverter
+{
+  public:
+	SpecializedReverseDCIconverter(ResponseCurve curve, float gamma,
+									ColorSpace color, ChromaticAdaptation adapt, int temperature,
+									bool normalize, float xyz_gamma, Precision precision) :
+		ReverseDCIconverter(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision),
+		_matrix(_xyz2rgb_matrix * (normalize ? 52.37f / 48.f : 1.f)),
+		_rgb_encode(1.f / gamma)
+	{
+		assert(curve == CURVE && (xyz_gamma == 1.f) == UNIT_XYZ);
+	}
+	
+	virtual Pixel convert(const Pixel &pix) const
+	{
+		Pixel out;
+		
+		convertPixel(&pix[0], &out[0]);
+		
+		return out;
+	}
+	
+  private:
+	const Matrix _matrix;
+	const float _rgb_encode;
+	
+	inline float delinearize(float in) const
+	{
+		switch(CURVE)
+		{
+			case sRGB:			return LinTosRGB(in);
+			case Rec709:		return LinToRec709(in);
+			case ProPhotoRGB:	return LinToProPhotoRGB(in);
+			case P3:			return GammaFunc(in, 1.f / 2.6f);
+			case Gamma:			return GammaFunc(in, _rgb_encode);
+			default:			return in;
+		}
+	}
+	
+	inline void convertPixel(const float *in, float *out) const
+	{
+		const Matrix &m = _matrix;
+		
+		float x = in[0];
+		float y = in[1];
+		float z = in[2];
+		
+		if(!UNIT_XYZ)
+		{
+			x = GammaFunc(x, _xyz_gamma);
+			y = GammaFunc(y, _xyz_gamma);
+			z = GammaFunc(z, _xyz_gamma);
+		}
+		
+		out[0] = delinearize(x * m[0][0] + y * m[1][0] + z * m[2][0]);
+		out[1] = delinearize(x * m[0][1] + y * m[1][1] + z * m[2][1]);
+		out[2] = delinearize(x * m[0][2] + y * m[1][2] + z * m[2][2]);
+	}
+};
+
+
+template <template <DCIconverterBase::ResponseCurve, bool> class CONVERTER,
+			DCIconverterBase::ResponseCurve CURVE>
+static DCIconverterBase *
+NewSpecialized(DCIconverterBase::ResponseCurve curve, float gamma,
+				DCIconverterBase::ColorSpace color, DCIconverterBase::ChromaticAdaptation adapt, int temperature,
+				bool normalize, float xyz_gamma, DCIconverterBase::Precision precision)
+{
+	if(xyz_gamma == 1.f)
+		return new CONVERTER<CURVE, true>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+	else
+		return new CONVERTER<CURVE, false>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+}
+
+
+template <template <DCIconverterBase::ResponseCurve, bool> class CONVERTER>
+static DCIconverterBase *
+NewSpecialized(DCIconverterBase::ResponseCurve curve, float gamma,
+				DCIconverterBase::ColorSpace color, DCIconverterBase::ChromaticAdaptation adapt, int temperature,
+				bool normalize, float xyz_gamma, DCIconverterBase::Precision precision)
+{
+	switch(curve)
+	{
+		case DCIconverterBase::sRGB:
+			return NewSpecialized<CONVERTER, DCIconverterBase::sRGB>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+		case DCIconverterBase::Rec709:
+			return NewSpecialized<CONVERTER, DCIconverterBase::Rec709>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+		case DCIconverterBase::ProPhotoRGB:
+			return NewSpecialized<CONVERTER, DCIconverterBase::ProPhotoRGB>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+		case DCIconverterBase::P3:
+			return NewSpecialized<CONVERTER, DCIconverterBase::P3>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+		case DCIconverterBase::Gamma:
+			return NewSpecialized<CONVERTER, DCIconverterBase::Gamma>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+		default:
+			assert(curve == DCIconverterBase::Linear);
+			return NewSpecialized<CONVERTER, DCIconverterBase::Linear>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+	}
+}
+
+
+DCIconverterBase *
+DCIconverterBase::Create(bool forward, ResponseCurve curve, float gamma,
+							ColorSpace color, ChromaticAdaptation adapt, int temperature,
+							bool normalize, float xyz_gamma, Precision precision)
+{
+	if(forward)
+		return NewSpecialized<SpecializedForwardDCIconverter>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+	else
+		return NewSpecialized<SpecializedReverseDCIconverter>(curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision);
+}
@@ -0,0 +1,154 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_AVX2.cpp
+//
+// AVX2 + FMA conversion kernel, 8 pixels per instruction
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_SIMD.h"
+
+#if DCI_SIMD_X86
+
+#include <immintrin.h>
+
+// Only this file gets compiled for AVX2, and F16C for the half conversions.
+// The dispatcher in DCIconverter_SIMD.cpp checks the CPU before calling in here.
+#if defined(__clang__)
+	#pragma clang attribute push (__attribute__((target("avx2,fma,f16c"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx2,fma,f16c")
+#endif
+
+
+namespace {
+
+struct VecAVX2
+{
+	typedef __m256	F;
+	typedef __m256i	I;
+	typedef __m256	M;
+	
+	enum { Lanes = 8 };
+	
+	static inline F set1(float v) { return _mm256_set1_ps(v); }
+	static inline I seti(int v) { return _mm256_set1_epi32(v); }
+	static inline F loadu(const float *p) { return _mm256_loadu_ps(p); }
+	static inline void storeu(float *p, F v) { _mm256_storeu_ps(p, v); }
+	
+	static inline F add(F a, F b) { return _mm256_add_ps(a, b); }
+	static inline F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+	static inline F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+	static inline F div(F a, F b) { return _mm256_div_ps(a, b); }
+	static inline F fmadd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+	static inline F max(F a, F b) { return _mm256_max_ps(a, b); }
+	static inline F round(F a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	
+	static inline M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static inline M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static inline M eq_i(I a, I b) { return _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b)); }
+	static inline F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+	
+	static inline I and_i(I a, I b) { return _mm256_and_si256(a, b); }
+	static inline I or_i(I a, I b) { return _mm256_or_si256(a, b); }
+	static inline I add_i(I a, I b) { return _mm256_add_epi32(a, b); }
+	static inline I sub_i(I a, I b) { return _mm256_sub_epi32(a, b); }
+	static inline I srl23(I a) { return _mm256_srli_epi32(a, 23); }
+	static inline I sll23(I a) { return _mm256_slli_epi32(a, 23); }
+	
+	static inline I asint(F a) { return _mm256_castps_si256(a); }
+	static inline F asfloat(I a) { return _mm256_castsi256_ps(a); }
+	static inline F itof(I a) { return _mm256_cvtepi32_ps(a); }
+	static inline I ftoi(F a) { return _mm256_cvtps_epi32(a); }
+};
+
+} // namespace
+
+
+#include "DCIconverter_SIMDkernel.h"
+
+
+void
+DCIkernel_AVX2(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	VecKernel<VecAVX2>(params, r, g, b, count);
+}
+
+
+void
+DCIstageKernel_AVX2(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count)
+{
+	VecStageKernel<VecAVX2>(params, stage, r, g, b, count);
+}
+
+
+
+void
+DCIhalfToFloat_F16C(const half *in, float *out, size_t count)
+{
+	const unsigned short *bits = (const unsigned short *)in;
+	
+	size_t i = 0;
+	
+	for(; i + 8 <= count; i += 8)
+		_mm256_storeu_ps(out + i, _mm256_cvtph_ps( _mm_loadu_si128((const __m128i *)(bits + i)) ));
+	
+	for(; i < count; i++)
+		out[i] = _cvtsh_ss(bits[i]);
+}
+
+
+void
+DCIfloatToHalf_F16C(const float *in, half *out, size_t count)
+{
+	unsigned short *bits = (unsigned short *)out;
+	
+	size_t i = 0;
+	
+	for(; i + 8 <= count; i += 8)
+		_mm_storeu_si128((__m128i *)(bits + i), _mm256_cvtps_ph(_mm256_loadu_ps(in + i), _MM_FROUND_TO_NEAREST_INT));
+	
+	for(; i < count; i++)
+		bits[i] = _cvtss_sh(in[i], _MM_FROUND_TO_NEAREST_INT);
+}
+
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+#endif // DCI_SIMD_X86
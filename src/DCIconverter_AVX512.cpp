@@ -0,0 +1,134 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_AVX512.cpp
+//
+// AVX-512 conversion kernel, 16 pixels per instruction
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_SIMD.h"
+
+#if DCI_SIMD_X86
+
+#include <immintrin.h>
+
+// Only this file gets compiled for AVX512.  The dispatcher in
+// DCIconverter_SIMD.cpp checks the CPU before calling in here.
+#if defined(__clang__)
+	#pragma clang attribute push (__attribute__((target("avx512f"))), apply_to = function)
+#elif defined(__GNUC__)
+	#pragma GCC push_options
+	#pragma GCC target("avx512f")
+#endif
+
+
+namespace {
+
+struct VecAVX512
+{
+	typedef __m512		F;
+	typedef __m512i		I;
+	typedef __mmask16	M;
+	
+	enum { Lanes = 16 };
+	
+	static inline F set1(float v) { return _mm512_set1_ps(v); }
+	static inline I seti(int v) { return _mm512_set1_epi32(v); }
+	static inline F loadu(const float *p) { return _mm512_loadu_ps(p); }
+	static inline void storeu(float *p, F v) { _mm512_storeu_ps(p, v); }
+	
+	static inline F add(F a, F b) { return _mm512_add_ps(a, b); }
+	static inline F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+	static inline F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+	static inline F div(F a, F b) { return _mm512_div_ps(a, b); }
+	static inline F fmadd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+	static inline F max(F a, F b) { return _mm512_max_ps(a, b); }
+	static inline F round(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+	
+	static inline M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static inline M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static inline M eq_i(I a, I b) { return _mm512_cmpeq_epi32_mask(a, b); }
+	static inline F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+	
+	static inline I and_i(I a, I b) { return _mm512_and_epi32(a, b); }
+	static inline I or_i(I a, I b) { return _mm512_or_epi32(a, b); }
+	static inline I add_i(I a, I b) { return _mm512_add_epi32(a, b); }
+	static inline I sub_i(I a, I b) { return _mm512_sub_epi32(a, b); }
+	static inline I srl23(I a) { return _mm512_srli_epi32(a, 23); }
+	static inline I sll23(I a) { return _mm512_slli_epi32(a, 23); }
+	
+	static inline I asint(F a) { return _mm512_castps_si512(a); }
+	static inline F asfloat(I a) { return _mm512_castsi512_ps(a); }
+	static inline F itof(I a) { return _mm512_cvtepi32_ps(a); }
+	static inline I ftoi(F a) { return _mm512_cvtps_epi32(a); }
+};
+
+} // namespace
+
+
+// GCC's AVX-512 intrinsics start from _mm512_undefined_ps() and friends,
+// which -Wmaybe-uninitialized reports once per use after inlining.
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic push
+	#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+#endif
+
+#include "DCIconverter_SIMDkernel.h"
+
+#if defined(__GNUC__) && !defined(__clang__)
+	#pragma GCC diagnostic pop
+#endif
+
+
+void
+DCIkernel_AVX512(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	VecKernel<VecAVX512>(params, r, g, b, count);
+}
+
+
+void
+DCIstageKernel_AVX512(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count)
+{
+	VecStageKernel<VecAVX512>(params, stage, r, g, b, count);
+}
+
+
+#if defined(__clang__)
+	#pragma clang attribute pop
+#elif defined(__GNUC__)
+	#pragma GCC pop_options
+#endif
+
+#endif // DCI_SIMD_X86
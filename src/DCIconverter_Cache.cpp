@@ -0,0 +1,158 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Cache.cpp
+//
+// Shared converters, so a host doesn't rebuild one for every frame
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Cache.h"
+
+
+bool
+ConverterCache::Key::operator < (const Key &other) const
+{
+	if(forward != other.forward)
+		return forward < other.forward;
+	else if(curve != other.curve)
+		return curve < other.curve;
+	else if(gamma != other.gamma)
+		return gamma < other.gamma;
+	else if(color != other.color)
+		return color < other.color;
+	else if(adapt != other.adapt)
+		return adapt < other.adapt;
+	else if(temperature != other.temperature)
+		return temperature < other.temperature;
+	else if(normalize != other.normalize)
+		return normalize < other.normalize;
+	else if(xyz_gamma != other.xyz_gamma)
+		return xyz_gamma < other.xyz_gamma;
+	else
+		return precision < other.precision;
+}
+
+
+ConverterCache::ConverterCache(size_t capacity) :
+	_capacity(capacity > 0 ? capacity : 1)
+{
+
+}
+
+
+ConverterCache::ConverterPtr
+ConverterCache::get(bool forward, DCIconverterBase::ResponseCurve curve, float gamma,
+					DCIconverterBase::ColorSpace color, DCIconverterBase::ChromaticAdaptation adapt, int temperature,
+					bool normalize, float xyz_gamma, DCIconverterBase::Precision precision)
+{
+	Key key;
+	
+	key.forward = forward;
+	key.curve = curve;
+	key.color = color;
+	key.adapt = adapt;
+	key.normalize = normalize;
+	key.xyz_gamma = xyz_gamma;
+	key.precision = precision;
+	
+	// parameters the converter ignores shouldn't make a new one
+	key.gamma = (curve == DCIconverterBase::Gamma ? gamma : 0.f);
+	key.temperature = (adapt == DCIconverterBase::Temp ? temperature : 0);
+	
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		
+		ConverterPtr converter = find(key);
+		
+		if(converter)
+			return converter;
+	}
+	
+	
+	ConverterPtr converter( DCIconverterBase::Create(forward, curve, gamma, color, adapt, temperature, normalize, xyz_gamma, precision) );
+	
+	
+	std::lock_guard<std::mutex> lock(_mutex);
+	
+	// another thread may have built the same one in the meantime
+	ConverterPtr existing = find(key);
+	
+	if(existing)
+		return existing;
+	
+	_entries.push_front( Entry(key, converter) );
+	_index[key] = _entries.begin();
+	
+	while(_entries.size() > _capacity)
+	{
+		_index.erase(_entries.back().first);
+		_entries.pop_back();
+	}
+	
+	return converter;
+}
+
+
+ConverterCache::ConverterPtr
+ConverterCache::find(const Key &key)
+{
+	std::map<Key, EntryList::iterator>::iterator found = _index.find(key);
+	
+	if(found == _index.end())
+		return ConverterPtr();
+	
+	// move to the front, list iterators stay valid
+	_entries.splice(_entries.begin(), _entries, found->second);
+	
+	return found->second->second;
+}
+
+
+void
+ConverterCache::clear()
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	
+	_index.clear();
+	_entries.clear();
+}
+
+
+size_t
+ConverterCache::size() const
+{
+	std::lock_guard<std::mutex> lock(_mutex);
+	
+	return _entries.size();
+}
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Cache.h
+//
+// Shared converters, so a host doesn't rebuild one for every frame
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_CACHE_H
+#define INCLUDED_DCI_CONVERTER_CACHE_H
+
+
+#include "DCIconverter.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+
+// Keeps the most recently used converters around, keyed by the full set of
+// parameters.  Converters are immutable once built, so one can be handed to
+// any number of render threads at once, and it stays alive for as long as
+// somebody holds it even after the cache lets go.
+//
+// get() can be called from any thread.  A miss builds the converter outside
+// the lock, so other threads keep getting hits while a big one is built.
+
+class ConverterCache
+{
+  public:
+	typedef std::shared_ptr<const DCIconverterBase> ConverterPtr;
+	
+	ConverterCache(size_t capacity = 8);
+	
+	ConverterPtr get(bool forward, DCIconverterBase::ResponseCurve curve, float gamma,
+						DCIconverterBase::ColorSpace color, DCIconverterBase::ChromaticAdaptation adapt, int temperature,
+						bool normalize, float xyz_gamma,
+						DCIconverterBase::Precision precision = DCIconverterBase::Exact);
+	
+	void clear();
+	
+	size_t size() const;
+	size_t capacity() const { return _capacity; }
+	
+  private:
+	typedef struct Key {
+		bool forward;
+		DCIconverterBase::ResponseCurve curve;
+		float gamma;
+		DCIconverterBase::ColorSpace color;
+		DCIconverterBase::ChromaticAdaptation adapt;
+		int temperature;
+		bool normalize;
+		float xyz_gamma;
+		DCIconverterBase::Precision precision;
+		
+		bool operator < (const Key &other) const;
+	} Key;
+	
+	typedef std::pair<Key, ConverterPtr> Entry;
+	typedef std::list<Entry> EntryList; // most recently used first
+	
+	const size_t _capacity;
+	
+	mutable std::mutex _mutex;
+	EntryList _entries;
+	std::map<Key, EntryList::iterator> _index;
+	
+	// call with the mutex held
+	ConverterPtr find(const Key &key);
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_CACHE_H
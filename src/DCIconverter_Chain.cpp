@@ -0,0 +1,492 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Chain.cpp
+//
+// Converters run one after the other, fused into as few passes as possible
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Chain.h"
+
+#include "DCIconverter_Stats.h"
+
+#include <assert.h>
+#include <math.h>
+
+
+namespace {
+
+// A converter broken down into the steps its kernel would take
+typedef enum {
+	STAGE_LINEARIZE,	// sRGB, Rec. 709 or ProPhoto curve, R'G'B' to RGB
+	STAGE_DELINEARIZE,	// same curves, RGB to R'G'B'
+	STAGE_MATRIX,
+	STAGE_POWER,		// GammaFunc(): the X'Y'Z' gamma, and the P3 and Gamma curves
+	STAGE_CONVERTER		// one the kernels can't run
+} StageType;
+
+typedef struct {
+	StageType						type;
+	DCIconverterBase::ResponseCurve	curve;
+	float							power;
+	Imath::M33f						matrix;
+	const DCIconverterBase			*converter;
+} Stage;
+
+
+// Powers of 2.6 and 1 / 2.6 or matrices and their inverses don't multiply
+// out to exactly 1, close enough is treated as nothing at all.
+static const float IDENTITY_TOLERANCE = 1e-6f;
+
+
+static Stage
+CurveStage(StageType type, DCIconverterBase::ResponseCurve curve)
+{
+	Stage stage;
+	
+	stage.type = type;
+	stage.curve = curve;
+	stage.power = 1.f;
+	stage.converter = NULL;
+	
+	return stage;
+}
+
+
+static Stage
+PowerStage(float power)
+{
+	Stage stage = CurveStage(STAGE_POWER, DCIconverterBase::Linear);
+	
+	stage.power = power;
+	
+	return stage;
+}
+
+
+static Stage
+MatrixStage(const float matrix[3][3])
+{
+	Stage stage = CurveStage(STAGE_MATRIX, DCIconverterBase::Linear);
+	
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
+			stage.matrix[i][j] = matrix[i][j];
+	
+	return stage;
+}
+
+
+static bool
+IsIdentity(const Stage &stage)
+{
+	if(stage.type == STAGE_POWER)
+	{
+		return (fabsf(stage.power - 1.f) <= IDENTITY_TOLERANCE);
+	}
+	else if(stage.type == STAGE_MATRIX)
+	{
+		for(int i=0; i < 3; i++)
+			for(int j=0; j < 3; j++)
+				if(fabsf(stage.matrix[i][j] - (i == j ? 1.f : 0.f)) > IDENTITY_TOLERANCE)
+					return false;
+		
+		return true;
+	}
+	else
+		return false;
+}
+
+
+static bool
+IsInversePair(const Stage &a, const Stage &b)
+{
+	return (a.curve == b.curve &&
+			((a.type == STAGE_LINEARIZE && b.type == STAGE_DELINEARIZE) ||
+			 (a.type == STAGE_DELINEARIZE && b.type == STAGE_LINEARIZE)) );
+}
+
+
+// Adds a stage, combining it with the last one if they fuse.  Nothing left
+// in stages can fuse with its neighbor, so only the last one needs a look.
+static void
+Push(std::vector<Stage> &stages, const Stage &stage)
+{
+	if( IsIdentity(stage) )
+		return;
+	
+	if( !stages.empty() )
+	{
+		const Stage last = stages.back();
+		
+		if(last.type == STAGE_POWER && stage.type == STAGE_POWER)
+		{
+			// GammaFunc(GammaFunc(x, a), b) == GammaFunc(x, a * b), signs included
+			stages.pop_back();
+			Push(stages, PowerStage(last.power * stage.power));
+			return;
+		}
+		else if(last.type == STAGE_MATRIX && stage.type == STAGE_MATRIX)
+		{
+			// row vectors, so the first matrix goes on the left
+			Stage product = last;
+			product.matrix = last.matrix * stage.matrix;
+			
+			stages.pop_back();
+			Push(stages, product);
+			return;
+		}
+		else if( IsInversePair(last, stage) )
+		{
+			stages.pop_back();
+			return;
+		}
+	}
+	
+	stages.push_back(stage);
+}
+
+
+static void
+PushCurve(std::vector<Stage> &stages, const DCIkernelParams &params, StageType type)
+{
+	if(params.curve == DCIconverterBase::P3 || params.curve == DCIconverterBase::Gamma)
+		Push(stages, PowerStage(params.gamma));
+	else if(params.curve != DCIconverterBase::Linear)
+		Push(stages, CurveStage(type, params.curve));
+}
+
+
+static void
+InitParams(DCIkernelParams &params, bool forward, DCIconverterBase::Precision precision)
+{
+	params.forward = forward;
+	params.curve = DCIconverterBase::Linear;
+	params.gamma = 1.f;
+	params.scale = 1.f;
+	params.xyz_gamma = 1.f;
+	params.precision = precision;
+	
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
+			params.matrix[i][j] = (i == j ? 1.f : 0.f);
+}
+
+
+static void
+SetMatrix(DCIkernelParams &params, const Stage &stage)
+{
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
+			params.matrix[i][j] = stage.matrix[i][j];
+}
+
+
+// The kernels run curve, matrix, power forward and power, matrix, curve
+// in reverse, any of them optional.  These take as many stages from i as
+// fit one pass and return how many that was.
+
+static size_t
+ForwardPass(const std::vector<Stage> &stages, size_t i, DCIkernelParams &params)
+{
+	size_t n = i;
+	
+	if(n < stages.size() && stages[n].type == STAGE_LINEARIZE)
+	{
+		params.curve = stages[n++].curve;
+	}
+	else if(n < stages.size() && stages[n].type == STAGE_POWER)
+	{
+		params.curve = DCIconverterBase::Gamma;
+		params.gamma = stages[n++].power;
+	}
+	
+	if(n < stages.size() && stages[n].type == STAGE_MATRIX)
+		SetMatrix(params, stages[n++]);
+	
+	if(n < stages.size() && stages[n].type == STAGE_POWER)
+		params.xyz_gamma = stages[n++].power;
+	
+	return n - i;
+}
+
+
+static size_t
+ReversePass(const std::vector<Stage> &stages, size_t i, DCIkernelParams &params)
+{
+	size_t n = i;
+	
+	if(n < stages.size() && stages[n].type == STAGE_POWER)
+		params.xyz_gamma = stages[n++].power;
+	
+	if(n < stages.size() && stages[n].type == STAGE_MATRIX)
+		SetMatrix(params, stages[n++]);
+	
+	if(n < stages.size() && stages[n].type == STAGE_DELINEARIZE)
+	{
+		params.curve = stages[n++].curve;
+	}
+	else if(n < stages.size() && stages[n].type == STAGE_POWER)
+	{
+		params.curve = DCIconverterBase::Gamma;
+		params.gamma = stages[n++].power;
+	}
+	
+	return n - i;
+}
+
+} // namespace
+
+
+DCIconverterChain::DCIconverterChain(const std::vector<const DCIconverterBase *> &converters) :
+	_converters(converters)
+{
+	build();
+}
+
+
+DCIconverterChain::DCIconverterChain(const DCIconverterBase &first, const DCIconverterBase &second)
+{
+	_converters.push_back(&first);
+	_converters.push_back(&second);
+	
+	build();
+}
+
+
+void
+DCIconverterChain::build()
+{
+	std::vector<Stage> stages;
+	
+	Precision precision = Accurate12;
+	
+	for(size_t c=0; c < _converters.size(); c++)
+	{
+		const DCIconverterBase *converter = _converters[c];
+		
+		assert(converter != NULL);
+		
+		DCIkernelParams params;
+		
+		if( !converter->kernelParams(params) )
+		{
+			Stage stage = CurveStage(STAGE_CONVERTER, Linear);
+			stage.converter = converter;
+			
+			stages.push_back(stage);
+			continue;
+		}
+		
+		if(params.precision < precision)
+			precision = params.precision;
+		
+		// folds the normalization into the matrix
+		DCIplan plan;
+		DCIlowerPlan(params, plan);
+		
+		const DCIkernelParams &lowered = plan.params;
+		
+		if(lowered.forward)
+		{
+			PushCurve(stages, lowered, STAGE_LINEARIZE);
+			Push(stages, MatrixStage(lowered.matrix));
+			Push(stages, PowerStage(lowered.xyz_gamma));
+		}
+		else
+		{
+			Push(stages, PowerStage(lowered.xyz_gamma));
+			Push(stages, MatrixStage(lowered.matrix));
+			PushCurve(stages, lowered, STAGE_DELINEARIZE);
+		}
+	}
+	
+	
+	// pack what's left into passes, whichever direction takes more stages at a time
+	size_t i = 0;
+	
+	while(i < stages.size())
+	{
+		Pass pass;
+		
+		if(stages[i].type == STAGE_CONVERTER)
+		{
+			pass.converter = stages[i++].converter;
+			
+			_passes.push_back(pass);
+			continue;
+		}
+		
+		DCIkernelParams forward, reverse;
+		
+		InitParams(forward, true, precision);
+		InitParams(reverse, false, precision);
+		
+		const size_t forward_stages = ForwardPass(stages, i, forward);
+		const size_t reverse_stages = ReversePass(stages, i, reverse);
+		
+		assert(forward_stages > 0 || reverse_stages > 0);
+		
+		pass.converter = NULL;
+		
+		DCIlowerPlan(forward_stages >= reverse_stages ? forward : reverse, pass.plan);
+		
+		_passes.push_back(pass);
+		
+		i += (forward_stages >= reverse_stages ? forward_stages : reverse_stages);
+	}
+}
+
+
+Pixel
+DCIconverterChain::convert(const Pixel &pix) const
+{
+	Pixel result = pix;
+	
+	for(size_t c=0; c < _converters.size(); c++)
+		result = _converters[c]->convert(result);
+	
+	return result;
+}
+
+
+void
+DCIconverterChain::convertBlock(float *r, float *g, float *b, size_t count) const
+{
+	float *const planes[3] = { r, g, b };
+	
+	for(size_t p=0; p < _passes.size(); p++)
+	{
+		const Pass &pass = _passes[p];
+		
+		if(pass.converter != NULL)
+			pass.converter->convertPlanar(planes, planes, count);
+		else
+			DCIplanRun(pass.plan, r, g, b, count);
+	}
+}
+
+
+// Every pass goes over a block before the next one starts, small enough
+// that the block stays in L1 between them.
+static const size_t BLOCK_SIZE = 256;
+
+
+void
+DCIconverterChain::convertSpan(const float *in, float *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	float r[BLOCK_SIZE];
+	float g[BLOCK_SIZE];
+	float b[BLOCK_SIZE];
+	
+	while(count > 0)
+	{
+		const size_t n = (count < BLOCK_SIZE ? count : BLOCK_SIZE);
+		
+		const float *pix = in;
+		
+		for(size_t i=0; i < n; i++)
+		{
+			r[i] = pix[0];
+			g[i] = pix[1];
+			b[i] = pix[2];
+			
+			pix += inStride;
+		}
+		
+		convertBlock(r, g, b, n);
+		
+		const float *const planes[3] = { r, g, b };
+		
+		ConverterInstruments::CountOutput(planes, n, 1);
+		
+		float *outpix = out;
+		
+		for(size_t i=0; i < n; i++)
+		{
+			outpix[0] = r[i];
+			outpix[1] = g[i];
+			outpix[2] = b[i];
+			
+			outpix += outStride;
+		}
+		
+		in += n * inStride;
+		out += n * outStride;
+		count -= n;
+	}
+}
+
+
+void
+DCIconverterChain::convertPlanar(const float *const in[3], float *const out[3], size_t count,
+									size_t inStride, size_t outStride) const
+{
+	float r[BLOCK_SIZE];
+	float g[BLOCK_SIZE];
+	float b[BLOCK_SIZE];
+	
+	for(size_t done=0; done < count; done += BLOCK_SIZE)
+	{
+		const size_t n = (count - done < BLOCK_SIZE ? count - done : BLOCK_SIZE);
+		
+		// packed output planes are converted where they are
+		float *const planes[3] = {	(outStride == 1 ? out[0] + done : r),
+									(outStride == 1 ? out[1] + done : g),
+									(outStride == 1 ? out[2] + done : b) };
+		
+		for(int c=0; c < 3; c++)
+		{
+			const float *src = in[c] + (done * inStride);
+			
+			if(src != planes[c] || inStride != 1)
+			{
+				for(size_t i=0; i < n; i++)
+					planes[c][i] = src[i * inStride];
+			}
+		}
+		
+		convertBlock(planes[0], planes[1], planes[2], n);
+		
+		ConverterInstruments::CountOutput(planes, n, 1);
+		
+		if(outStride != 1)
+		{
+			for(int c=0; c < 3; c++)
+				for(size_t i=0; i < n; i++)
+					out[c][(done + i) * outStride] = planes[c][i];
+		}
+	}
+}
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Chain.h
+//
+// Converters run one after the other, fused into as few passes as possible
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_CHAIN_H
+#define INCLUDED_DCI_CONVERTER_CHAIN_H
+
+
+#include "DCIconverter.h"
+#include "DCIconverter_SIMD.h"
+
+
+// Runs each converter on the output of the one before, as if they were
+// applied in turn, but without going through the whole frame once per
+// converter.  The usual chain is a Forward converter to X'Y'Z' followed by
+// a Reverse one to a display's RGB, for a preview of what the DCP will look
+// like.
+//
+// Converters that describe themselves with kernelParams() are broken down
+// into curves, matrices and powers, and neighbors are combined: powers
+// multiply (so an X'Y'Z' gamma and the matching degamma cancel), matrices
+// multiply, and a curve followed by its own inverse disappears.  What's
+// left is packed into as few kernel passes as possible, which run one
+// cache-sized block at a time.  Other converters, like a LUT, are a pass
+// of their own.  Forward then Reverse with the same X'Y'Z' gamma comes down
+// to input curve, one matrix and output curve, about the cost of a single
+// conversion.
+//
+// Results match running the converters in turn to within float rounding,
+// apart from the X'Y'Z' values in the middle never being rounded at all.
+// Passes use the most exact of the converters' precisions.  convert()
+// runs the converters in turn.
+//
+// The converters aren't copied, they have to outlive the chain.
+
+class DCIconverterChain : public DCIconverterBase
+{
+  public:
+	DCIconverterChain(const std::vector<const DCIconverterBase *> &converters);
+	DCIconverterChain(const DCIconverterBase &first, const DCIconverterBase &second);
+	
+	virtual ~DCIconverterChain() {}
+	
+	virtual Pixel convert(const Pixel &pix) const;
+	
+	using DCIconverterBase::convertSpan;
+	
+	virtual void convertSpan(const float *in, float *out, size_t count,
+								size_t inStride = 3, size_t outStride = 3) const;
+	
+	virtual void convertPlanar(const float *const in[3], float *const out[3], size_t count,
+								size_t inStride = 1, size_t outStride = 1) const;
+	
+	// passes left after fusion, 0 if the converters cancel out completely
+	size_t passes() const { return _passes.size(); }
+	
+  private:
+	typedef struct {
+		const DCIconverterBase *converter; // NULL for a kernel pass
+		DCIplan plan;
+	} Pass;
+	
+	std::vector<const DCIconverterBase *> _converters;
+	std::vector<Pass> _passes;
+	
+	void build();
+	
+	// in place on packed planes
+	void convertBlock(float *r, float *g, float *b, size_t count) const;
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_CHAIN_H
@@ -0,0 +1,409 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Image.cpp
+//
+// Whole frames, converted a tile at a time on a thread pool
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Image.h"
+
+#include "DCIconverter_Trace.h"
+
+#include "IexBaseExc.h"
+
+#include <string.h>
+
+
+typedef struct {
+	int channels;
+	int red;
+	int green;
+	int blue;
+	int alpha; // -1 for none
+} LayoutInfo;
+
+static LayoutInfo
+GetLayoutInfo(ImageView::Layout layout)
+{
+	switch(layout)
+	{
+		case ImageView::RGB:	{ const LayoutInfo info = { 3, 0, 1, 2, -1 };	return info; }
+		case ImageView::RGBA:	{ const LayoutInfo info = { 4, 0, 1, 2, 3 };	return info; }
+		case ImageView::ARGB:	{ const LayoutInfo info = { 4, 1, 2, 3, 0 };	return info; }
+		case ImageView::BGRA:	{ const LayoutInfo info = { 4, 2, 1, 0, 3 };	return info; }
+	}
+	
+	throw Iex::ArgExc("Unknown pixel layout.");
+}
+
+
+static size_t
+ChannelBytes(ImageView::ChannelType type)
+{
+	switch(type)
+	{
+		case ImageView::UInt8:	return sizeof(unsigned char);
+		case ImageView::UInt16:	return sizeof(unsigned short);
+		case ImageView::Half:	return sizeof(half);
+		case ImageView::Float:	return sizeof(float);
+	}
+	
+	throw Iex::ArgExc("Unknown channel type.");
+}
+
+
+size_t
+ImageView::pixelBytes() const
+{
+	return GetLayoutInfo(layout).channels * ChannelBytes(type);
+}
+
+
+ImageView
+ImageView::region(const ImageRect &rect) const
+{
+	if(rect.left < 0 || rect.top < 0 || rect.width < 0 || rect.height < 0 ||
+		rect.width > width - rect.left || rect.height > height - rect.top)
+	{
+		throw Iex::ArgExc("Region is outside the image.");
+	}
+	
+	char *origin = (char *)data + (rect.top * rowBytes) + (rect.left * (ptrdiff_t)pixelBytes());
+	
+	return ImageView(origin, rect.width, rect.height, rowBytes, layout, type);
+}
+
+
+static inline bool
+IsPacked(const LayoutInfo &info)
+{
+	// R, G and B next to each other in that order, so the converter can
+	// work on the image directly
+	return (info.green == info.red + 1 && info.blue == info.red + 2);
+}
+
+
+template <typename T> static inline float ChannelMax();
+template <> inline float ChannelMax<unsigned char>() { return DCIconverterBase::MAX_CHAN8; }
+template <> inline float ChannelMax<unsigned short>() { return DCIconverterBase::MAX_CHAN16; }
+template <> inline float ChannelMax<half>() { return 1.f; }
+template <> inline float ChannelMax<float>() { return 1.f; }
+
+
+template <typename IN_TYPE, typename OUT_TYPE>
+static inline OUT_TYPE
+ConvertAlpha(IN_TYPE in)
+{
+	// only same type or integer to float
+	return (ChannelMax<IN_TYPE>() == ChannelMax<OUT_TYPE>() ? (OUT_TYPE)in :
+				(OUT_TYPE)((float)in / ChannelMax<IN_TYPE>()));
+}
+
+
+template <typename IN_TYPE, typename OUT_TYPE>
+static void
+CopyAlpha(const IN_TYPE *in, const LayoutInfo &in_info,
+			OUT_TYPE *out, const LayoutInfo &out_info,
+			int width)
+{
+	if(out_info.alpha >= 0)
+	{
+		for(int i=0; i < width; i++)
+		{
+			out[out_info.alpha] = (in_info.alpha >= 0 ? ConvertAlpha<IN_TYPE, OUT_TYPE>(in[in_info.alpha]) :
+														(OUT_TYPE)ChannelMax<OUT_TYPE>());
+			
+			in += in_info.channels;
+			out += out_info.channels;
+		}
+	}
+}
+
+
+template <typename IN_TYPE, typename OUT_TYPE>
+static void
+ConvertRow(const DCIconverterBase &converter,
+			const IN_TYPE *in, const LayoutInfo &in_info,
+			OUT_TYPE *out, const LayoutInfo &out_info,
+			int width)
+{
+	if(IsPacked(in_info) && IsPacked(out_info))
+	{
+		converter.convertRuns(in + in_info.red, out + out_info.red, width,
+								in_info.channels, out_info.channels);
+	}
+	else
+	{
+		// gather into packed RGB a chunk at a time
+		const int chunk_size = 256;
+		
+		IN_TYPE inbuf[chunk_size * 3];
+		OUT_TYPE outbuf[chunk_size * 3];
+		
+		for(int done=0; done < width; done += chunk_size)
+		{
+			const int count = (width - done < chunk_size ? width - done : chunk_size);
+			
+			const IN_TYPE *inpix = in + (done * in_info.channels);
+			OUT_TYPE *outpix = out + (done * out_info.channels);
+			
+			for(int i=0; i < count; i++)
+			{
+				inbuf[(i * 3) + 0] = inpix[in_info.red];
+				inbuf[(i * 3) + 1] = inpix[in_info.green];
+				inbuf[(i * 3) + 2] = inpix[in_info.blue];
+				
+				inpix += in_info.channels;
+			}
+			
+			converter.convertRuns(inbuf, outbuf, count);
+			
+			for(int i=0; i < count; i++)
+			{
+				outpix[out_info.red] = outbuf[(i * 3) + 0];
+				outpix[out_info.green] = outbuf[(i * 3) + 1];
+				outpix[out_info.blue] = outbuf[(i * 3) + 2];
+				
+				outpix += out_info.channels;
+			}
+		}
+	}
+	
+	
+	CopyAlpha(in, in_info, out, out_info, width);
+}
+
+
+template <typename IN_TYPE, typename OUT_TYPE>
+static void
+FillRow(const OUT_TYPE fill[3],
+		const IN_TYPE *in, const LayoutInfo &in_info,
+		OUT_TYPE *out, const LayoutInfo &out_info,
+		int width)
+{
+	OUT_TYPE *outpix = out;
+	
+	for(int i=0; i < width; i++)
+	{
+		outpix[out_info.red] = fill[0];
+		outpix[out_info.green] = fill[1];
+		outpix[out_info.blue] = fill[2];
+		
+		outpix += out_info.channels;
+	}
+	
+	CopyAlpha(in, in_info, out, out_info, width);
+}
+
+
+typedef struct {
+	int left;
+	int top;
+	int width;
+	int height;
+} Tile;
+
+
+// Channels compared bit for bit, like convertRuns()
+static inline unsigned int ChannelBits(unsigned char v) { return v; }
+static inline unsigned int ChannelBits(unsigned short v) { return v; }
+static inline unsigned int ChannelBits(half v) { return v.bits(); }
+static inline unsigned int ChannelBits(float v) { unsigned int b; memcpy(&b, &v, sizeof(b)); return b; }
+
+
+template <typename T>
+static bool
+IsConstant(const ImageView &image, const LayoutInfo &info)
+{
+	// stops at the first pixel that's different, which for most frames is
+	// the second one
+	const T *first = (const T *)image.data;
+	
+	const unsigned int red = ChannelBits(first[info.red]);
+	const unsigned int green = ChannelBits(first[info.green]);
+	const unsigned int blue = ChannelBits(first[info.blue]);
+	
+	for(int y=0; y < image.height; y++)
+	{
+		const T *pix = (const T *)((const char *)image.data + (y * image.rowBytes));
+		
+		for(int x=0; x < image.width; x++)
+		{
+			if(ChannelBits(pix[info.red]) != red ||
+				ChannelBits(pix[info.green]) != green ||
+				ChannelBits(pix[info.blue]) != blue)
+			{
+				return false;
+			}
+			
+			pix += info.channels;
+		}
+	}
+	
+	return true;
+}
+
+
+template <typename IN_TYPE, typename OUT_TYPE>
+static void
+ConvertImage(ThreadPool &pool, int tile_pixels, const DCIconverterBase &converter,
+				const ImageView &in, const ImageView &out)
+{
+	const LayoutInfo in_info = GetLayoutInfo(in.layout);
+	const LayoutInfo out_info = GetLayoutInfo(out.layout);
+	
+	
+	// A frame that's all one color (black leader, a slate) is converted
+	// once and filled.
+	const bool constant = IsConstant<IN_TYPE>(in, in_info);
+	
+	OUT_TYPE fill[3];
+	
+	if(constant)
+	{
+		const IN_TYPE *first = (const IN_TYPE *)in.data;
+		
+		const IN_TYPE pix[3] = { first[in_info.red], first[in_info.green], first[in_info.blue] };
+		
+		converter.convertSpan(pix, fill, 1);
+	}
+	
+	
+	// Whole rows if they fit in a tile, otherwise rows cut into pieces.
+	const int tile_width = (in.width < tile_pixels ? in.width : tile_pixels);
+	const int tile_height = (tile_pixels / tile_width > 0 ? tile_pixels / tile_width : 1);
+	
+	std::vector<Tile> tiles;
+	
+	for(int y=0; y < in.height; y += tile_height)
+	{
+		for(int x=0; x < in.width; x += tile_width)
+		{
+			const Tile tile = { x, y, (in.width - x < tile_width ? in.width - x : tile_width),
+										(in.height - y < tile_height ? in.height - y : tile_height) };
+			
+			tiles.push_back(tile);
+		}
+	}
+	
+	
+	pool.parallelFor(tiles.size(), [&](size_t t)
+	{
+		const ConverterTrace::Span span("tile", "image", t);
+		
+		const Tile &tile = tiles[t];
+		
+		for(int y = tile.top; y < tile.top + tile.height; y++)
+		{
+			const IN_TYPE *in_row = (const IN_TYPE *)((const char *)in.data + (y * in.rowBytes));
+			OUT_TYPE *out_row = (OUT_TYPE *)((char *)out.data + (y * out.rowBytes));
+			
+			if(constant)
+			{
+				FillRow(fill,
+						in_row + (tile.left * in_info.channels), in_info,
+						out_row + (tile.left * out_info.channels), out_info,
+						tile.width);
+			}
+			else
+			{
+				ConvertRow(converter,
+							in_row + (tile.left * in_info.channels), in_info,
+							out_row + (tile.left * out_info.channels), out_info,
+							tile.width);
+			}
+		}
+	});
+}
+
+
+ImageConverter::ImageConverter(ThreadPool &pool, int tilePixels) :
+	_pool(pool),
+	_tile_pixels(tilePixels > 0 ? tilePixels : 16384)
+{
+
+}
+
+
+void
+ImageConverter::convert(const DCIconverterBase &converter, const ImageView &in, const ImageView &out) const
+{
+	if(in.data == NULL || out.data == NULL)
+		throw Iex::ArgExc("Image has no pixels.");
+	
+	if(in.width != out.width || in.height != out.height)
+		throw Iex::ArgExc("Input and output images are different sizes.");
+	
+	if(in.width <= 0 || in.height <= 0)
+		return;
+	
+	const ConverterTrace::Span span("image", "image");
+	
+	
+	if(in.type == ImageView::UInt8)
+	{
+		if(out.type == ImageView::UInt8)
+			ConvertImage<unsigned char, unsigned char>(_pool, _tile_pixels, converter, in, out);
+		else if(out.type == ImageView::Float)
+			ConvertImage<unsigned char, float>(_pool, _tile_pixels, converter, in, out);
+		else
+			throw Iex::ArgExc("Can't convert 8-bit to 16-bit or half.");
+	}
+	else if(in.type == ImageView::UInt16)
+	{
+		if(out.type == ImageView::UInt16)
+			ConvertImage<unsigned short, unsigned short>(_pool, _tile_pixels, converter, in, out);
+		else if(out.type == ImageView::Float)
+			ConvertImage<unsigned short, float>(_pool, _tile_pixels, converter, in, out);
+		else
+			throw Iex::ArgExc("Can't convert 16-bit to 8-bit or half.");
+	}
+	else if(in.type == ImageView::Half)
+	{
+		if(out.type == ImageView::Half)
+			ConvertImage<half, half>(_pool, _tile_pixels, converter, in, out);
+		else if(out.type == ImageView::Float)
+			ConvertImage<half, float>(_pool, _tile_pixels, converter, in, out);
+		else
+			throw Iex::ArgExc("Can't convert half to integer.");
+	}
+	else
+	{
+		if(out.type == ImageView::Float)
+			ConvertImage<float, float>(_pool, _tile_pixels, converter, in, out);
+		else
+			throw Iex::ArgExc("Can't convert float to integer or half.");
+	}
+}
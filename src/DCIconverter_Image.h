@@ -0,0 +1,129 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Image.h
+//
+// Whole frames, converted a tile at a time on a thread pool
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_IMAGE_H
+#define INCLUDED_DCI_CONVERTER_IMAGE_H
+
+
+#include "DCIconverter.h"
+#include "DCIconverter_ThreadPool.h"
+
+
+// A rectangle of pixels, measured from an image's first pixel
+struct ImageRect
+{
+	ImageRect(int left, int top, int width, int height) :
+		left(left), top(top), width(width), height(height) {}
+	
+	int left;
+	int top;
+	int width;
+	int height;
+};
+
+
+// Describes pixels somebody else owns.  rowBytes can be negative for
+// bottom-up images.  16-bit channels use the converter's 0-32768 range.
+struct ImageView
+{
+	typedef enum {
+		RGB,
+		RGBA,
+		ARGB,	// After Effects
+		BGRA	// Premiere
+	} Layout;
+	
+	typedef enum {
+		UInt8,
+		UInt16,
+		Half,
+		Float
+	} ChannelType;
+	
+	ImageView(void *data, int width, int height, ptrdiff_t rowBytes,
+				Layout layout = RGBA, ChannelType type = Float) :
+		data(data), width(width), height(height), rowBytes(rowBytes), layout(layout), type(type) {}
+	
+	size_t pixelBytes() const;
+	
+	// The same pixels, cropped to rect.  Nothing is copied, the view points
+	// into this one with the same rowBytes.  Throws if rect isn't inside.
+	ImageView region(const ImageRect &rect) const;
+	
+	void *data;
+	int width;
+	int height;
+	ptrdiff_t rowBytes;
+	Layout layout;
+	ChannelType type;
+};
+
+
+// Converts a frame by splitting it into tiles of about tilePixels pixels,
+// small enough to stay in cache, and running them on a ThreadPool.
+//
+// in and out have to be the same size.  The channel types can be the same,
+// or integer or half in and float out.  out can be the same image as in.  Alpha is
+// copied over, or made opaque if in doesn't have any.
+
+class ImageConverter
+{
+  public:
+	ImageConverter(ThreadPool &pool = ThreadPool::Global(), int tilePixels = 16384);
+	
+	void convert(const DCIconverterBase &converter, const ImageView &in, const ImageView &out) const;
+	
+	// convert in place
+	void convert(const DCIconverterBase &converter, const ImageView &image) const { convert(converter, image, image); }
+	
+	// Only the pixels in roi, which is the same rectangle in both images.
+	// Nothing outside it is read or written, so a host can convert a dirty
+	// rect or a crop of a bigger frame, in place or into another buffer.
+	void convert(const DCIconverterBase &converter, const ImageView &in, const ImageView &out,
+					const ImageRect &roi) const { convert(converter, in.region(roi), out.region(roi)); }
+	
+	void convert(const DCIconverterBase &converter, const ImageView &image,
+					const ImageRect &roi) const { convert(converter, image, image, roi); }
+	
+  private:
+	ThreadPool &_pool;
+	const int _tile_pixels;
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_IMAGE_H
@@ -0,0 +1,365 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_LUT.cpp
+//
+// A whole conversion baked into a 3D LUT
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_LUT.h"
+
+#include "IexBaseExc.h"
+
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+#include <math.h>
+
+
+LUTDCIconverter::LUTDCIconverter(const DCIconverterBase &converter, int size,
+									float domainMin, float domainMax) :
+	_size(size),
+	_max_error(0.f)
+{
+	if(size < 2 || size > 256)
+		throw Iex::ArgExc("Invalid LUT size");
+	
+	setDomain(Pixel(domainMin), Pixel(domainMax));
+	
+	
+	_lattice.resize(3 * _size * _size * _size);
+	
+	float *pix = &_lattice[0];
+	
+	for(int b=0; b < _size; b++)
+	{
+		for(int g=0; g < _size; g++)
+		{
+			for(int r=0; r < _size; r++)
+			{
+				pix[0] = _domain_min.x + (_domain_max.x - _domain_min.x) * ((float)r / (float)(_size - 1));
+				pix[1] = _domain_min.y + (_domain_max.y - _domain_min.y) * ((float)g / (float)(_size - 1));
+				pix[2] = _domain_min.z + (_domain_max.z - _domain_min.z) * ((float)b / (float)(_size - 1));
+				
+				pix += 3;
+			}
+		}
+	}
+	
+	converter.convertSpan(&_lattice[0], &_lattice[0], _size * _size * _size);
+	
+	
+	_max_error = measureError(converter);
+}
+
+
+LUTDCIconverter::LUTDCIconverter(const std::string &path) :
+	_size(0),
+	_max_error(-1.f)
+{
+	std::ifstream file(path.c_str());
+	
+	if(!file)
+		throw Iex::IoExc("Unable to open " + path);
+	
+	
+	Pixel domainMin(0.f), domainMax(1.f);
+	
+	size_t count = 0;
+	
+	std::string line;
+	
+	while( std::getline(file, line) )
+	{
+		const size_t comment = line.find('#');
+		
+		if(comment != std::string::npos)
+			line.erase(comment);
+		
+		std::istringstream words(line);
+		
+		std::string key;
+		
+		if( !(words >> key) )
+			continue;
+		
+		const char first = key[0];
+		
+		if((first >= '0' && first <= '9') || first == '-' || first == '+' || first == '.')
+		{
+			if(count >= _lattice.size())
+				throw Iex::InputExc("Too many entries in " + path);
+			
+			std::istringstream values(line);
+			
+			values >> _lattice[count] >> _lattice[count + 1] >> _lattice[count + 2];
+			
+			if(!values)
+				throw Iex::InputExc("Bad LUT entry in " + path);
+			
+			count += 3;
+		}
+		else if(key == "LUT_3D_SIZE")
+		{
+			if(_size != 0 || !(words >> _size) || _size < 2 || _size > 256)
+				throw Iex::InputExc("Bad LUT_3D_SIZE in " + path);
+			
+			_lattice.resize(3 * _size * _size * _size);
+		}
+		else if(key == "DOMAIN_MIN")
+		{
+			if( !(words >> domainMin.x >> domainMin.y >> domainMin.z) )
+				throw Iex::InputExc("Bad DOMAIN_MIN in " + path);
+		}
+		else if(key == "DOMAIN_MAX")
+		{
+			if( !(words >> domainMax.x >> domainMax.y >> domainMax.z) )
+				throw Iex::InputExc("Bad DOMAIN_MAX in " + path);
+		}
+		else if(key == "LUT_3D_INPUT_RANGE")
+		{
+			// Resolve's way of saying the same thing
+			float lo, hi;
+			
+			if( !(words >> lo >> hi) )
+				throw Iex::InputExc("Bad LUT_3D_INPUT_RANGE in " + path);
+			
+			domainMin = Pixel(lo);
+			domainMax = Pixel(hi);
+		}
+		else if(key == "LUT_1D_SIZE")
+		{
+			throw Iex::InputExc("1D LUTs are not supported: " + path);
+		}
+		
+		// TITLE and anything else we don't know about gets ignored
+	}
+	
+	if(_size == 0 || count != _lattice.size())
+		throw Iex::InputExc("Incomplete LUT in " + path);
+	
+	setDomain(domainMin, domainMax);
+}
+
+
+void
+LUTDCIconverter::setDomain(const Pixel &domainMin, const Pixel &domainMax)
+{
+	for(int c=0; c < 3; c++)
+	{
+		if( !(domainMax[c] > domainMin[c]) )
+			throw Iex::ArgExc("Invalid LUT domain");
+		
+		_domain_scale[c] = (float)(_size - 1) / (domainMax[c] - domainMin[c]);
+	}
+	
+	_domain_min = domainMin;
+	_domain_max = domainMax;
+}
+
+
+inline void
+LUTDCIconverter::lookup(const float *in, float *out) const
+{
+	// Tetrahedral interpolation: the cube around the input is split into six
+	// tetrahedra along its main diagonal, and we blend the four corners of the
+	// one the input falls in.  Cheaper than trilinear (4 corners instead of 8)
+	// and keeps neutrals on the neutral axis.
+	const float last = (float)(_size - 1);
+	
+	float f[3];
+	int i[3];
+	
+	for(int c=0; c < 3; c++)
+	{
+		float v = (in[c] - _domain_min[c]) * _domain_scale[c];
+		
+		v = (v > 0.f ? (v < last ? v : last) : 0.f); // NaN goes to 0 too
+		
+		i[c] = (int)v;
+		
+		if(i[c] > _size - 2)
+			i[c] = _size - 2;
+		
+		f[c] = v - (float)i[c];
+	}
+	
+	const size_t sr = 3;
+	const size_t sg = 3 * _size;
+	const size_t sb = 3 * _size * _size;
+	
+	const float *c000 = &_lattice[(i[0] * sr) + (i[1] * sg) + (i[2] * sb)];
+	const float *c111 = c000 + sr + sg + sb;
+	
+	const float fr = f[0];
+	const float fg = f[1];
+	const float fb = f[2];
+	
+	// a and b are the other two corners, w0 >= w1 >= w2 are the sorted fractions
+	const float *a, *b;
+	float w0, w1, w2;
+	
+	if(fr > fg)
+	{
+		if(fg > fb)
+		{
+			a = c000 + sr;			b = c000 + sr + sg;
+			w0 = fr;	w1 = fg;	w2 = fb;
+		}
+		else if(fr > fb)
+		{
+			a = c000 + sr;			b = c000 + sr + sb;
+			w0 = fr;	w1 = fb;	w2 = fg;
+		}
+		else
+		{
+			a = c000 + sb;			b = c000 + sr + sb;
+			w0 = fb;	w1 = fr;	w2 = fg;
+		}
+	}
+	else
+	{
+		if(fb > fg)
+		{
+			a = c000 + sb;			b = c000 + sg + sb;
+			w0 = fb;	w1 = fg;	w2 = fr;
+		}
+		else if(fb > fr)
+		{
+			a = c000 + sg;			b = c000 + sg + sb;
+			w0 = fg;	w1 = fb;	w2 = fr;
+		}
+		else
+		{
+			a = c000 + sg;			b = c000 + sr + sg;
+			w0 = fg;	w1 = fr;	w2 = fb;
+		}
+	}
+	
+	for(int c=0; c < 3; c++)
+	{
+		out[c] = c000[c] + w0 * (a[c] - c000[c]) + w1 * (b[c] - a[c]) + w2 * (c111[c] - b[c]);
+	}
+}
+
+
+Pixel
+LUTDCIconverter::convert(const Pixel &pix) const
+{
+	Pixel out;
+	
+	lookup(&pix[0], &out[0]);
+	
+	return out;
+}
+
+
+void
+LUTDCIconverter::convertSpan(const float *in, float *out, size_t count,
+								size_t inStride, size_t outStride) const
+{
+	for(size_t i=0; i < count; i++)
+	{
+		lookup(in, out);
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+float
+LUTDCIconverter::measureError(const DCIconverterBase &reference) const
+{
+	float max_error = 0.f;
+	
+	const int cells = _size - 1;
+	
+	for(int b=0; b < cells; b++)
+	{
+		for(int g=0; g < cells; g++)
+		{
+			for(int r=0; r < cells; r++)
+			{
+				const Pixel pix( _domain_min.x + ((float)r + 0.5f) / _domain_scale.x,
+									_domain_min.y + ((float)g + 0.5f) / _domain_scale.y,
+									_domain_min.z + ((float)b + 0.5f) / _domain_scale.z );
+				
+				const Pixel exact = reference.convert(pix);
+				const Pixel interpolated = convert(pix);
+				
+				for(int c=0; c < 3; c++)
+				{
+					const float error = fabsf(exact[c] - interpolated[c]);
+					
+					if(error > max_error)
+						max_error = error;
+				}
+			}
+		}
+	}
+	
+	return max_error;
+}
+
+
+void
+LUTDCIconverter::writeCube(const std::string &path, const std::string &title) const
+{
+	std::ofstream file(path.c_str());
+	
+	if(!file)
+		throw Iex::IoExc("Unable to write " + path);
+	
+	file << "# Created by DCI Converter" << std::endl;
+	
+	if(_max_error >= 0.f)
+		file << "# Max interpolation error: " << _max_error << std::endl;
+	
+	file << "TITLE \"" << title << "\"" << std::endl;
+	file << "LUT_3D_SIZE " << _size << std::endl;
+	file << "DOMAIN_MIN " << _domain_min.x << " " << _domain_min.y << " " << _domain_min.z << std::endl;
+	file << "DOMAIN_MAX " << _domain_max.x << " " << _domain_max.y << " " << _domain_max.z << std::endl;
+	
+	file << std::fixed << std::setprecision(6);
+	
+	for(size_t i=0; i < _lattice.size(); i += 3)
+	{
+		file << _lattice[i] << " " << _lattice[i + 1] << " " << _lattice[i + 2] << "\n";
+	}
+	
+	if(!file)
+		throw Iex::IoExc("Error writing " + path);
+}
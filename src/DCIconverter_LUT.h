@@ -0,0 +1,102 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_LUT.h
+//
+// A whole conversion baked into a 3D LUT
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_LUT_H
+#define INCLUDED_DCI_CONVERTER_LUT_H
+
+
+#include "DCIconverter.h"
+
+#include <string>
+
+
+// Samples another converter (curve, matrix, adaptation, normalization and
+// X'Y'Z' gamma all together) on a size x size x size lattice and then
+// converts with tetrahedral interpolation.  Can also read and write
+// .cube files so the same transform can be used in other programs.
+//
+// Input outside the domain is clamped to it, as other .cube readers do.
+
+class LUTDCIconverter : public DCIconverterBase
+{
+  public:
+	// 33 or 65 are the usual sizes
+	LUTDCIconverter(const DCIconverterBase &converter, int size = 33,
+					float domainMin = 0.f, float domainMax = 1.f);
+	
+	// read a .cube file
+	LUTDCIconverter(const std::string &path);
+	
+	virtual ~LUTDCIconverter() {}
+	
+	virtual Pixel convert(const Pixel &pix) const;
+	
+	using DCIconverterBase::convertSpan;
+	
+	virtual void convertSpan(const float *in, float *out, size_t count,
+								size_t inStride = 3, size_t outStride = 3) const;
+	
+	void writeCube(const std::string &path, const std::string &title = "DCI Converter") const;
+	
+	int size() const { return _size; }
+	
+	// Largest difference from the baked converter's convert(), measured at the
+	// center of every lattice cell where interpolation is furthest from the samples.
+	// Returns -1 for a LUT that was read from a file.
+	float maxError() const { return _max_error; }
+	
+	// same measurement against any converter, say to check a .cube file
+	float measureError(const DCIconverterBase &reference) const;
+	
+  private:
+	int _size;
+	Pixel _domain_min;
+	Pixel _domain_max;
+	Pixel _domain_scale;
+	float _max_error;
+	
+	// RGB triples, red index changing fastest (.cube order)
+	std::vector<float> _lattice;
+	
+	void setDomain(const Pixel &domainMin, const Pixel &domainMax);
+	
+	inline void lookup(const float *in, float *out) const;
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_LUT_H
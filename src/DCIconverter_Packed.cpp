@@ -0,0 +1,530 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Packed.cpp
+//
+// Converting DPX and raw planar frames in memory-mapped files
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Packed.h"
+
+#include "DCIconverter_Trace.h"
+
+#include "IexBaseExc.h"
+
+#ifdef _WIN32
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
+
+MappedFile::MappedFile(const std::string &path) :
+	_data(NULL),
+	_size(0)
+{
+	map(path, false, 0);
+}
+
+
+MappedFile::MappedFile(const std::string &path, size_t size) :
+	_data(NULL),
+	_size(size)
+{
+	map(path, true, size);
+}
+
+
+#ifdef _WIN32
+
+void
+MappedFile::map(const std::string &path, bool write, size_t size)
+{
+	_file = CreateFileA(path.c_str(), (write ? GENERIC_READ | GENERIC_WRITE : GENERIC_READ),
+						(write ? 0 : FILE_SHARE_READ), NULL, (write ? CREATE_ALWAYS : OPEN_EXISTING),
+						(write ? FILE_ATTRIBUTE_NORMAL : FILE_FLAG_SEQUENTIAL_SCAN), NULL);
+	
+	if(_file == INVALID_HANDLE_VALUE)
+		throw Iex::IoExc("Can't open " + path);
+	
+	if(!write)
+	{
+		LARGE_INTEGER file_size;
+		
+		if( !GetFileSizeEx(_file, &file_size) )
+		{
+			CloseHandle(_file);
+			throw Iex::IoExc("Can't get the size of " + path);
+		}
+		
+		size = (size_t)file_size.QuadPart;
+	}
+	
+	if(size == 0)
+	{
+		CloseHandle(_file);
+		throw Iex::IoExc(path + " is empty");
+	}
+	
+	// making a writable mapping also sets the file size
+	_mapping = CreateFileMappingA(_file, NULL, (write ? PAGE_READWRITE : PAGE_READONLY),
+									(DWORD)((unsigned long long)size >> 32), (DWORD)(size & 0xffffffff), NULL);
+	
+	_data = (_mapping == NULL ? NULL :
+				(unsigned char *)MapViewOfFile(_mapping, (write ? FILE_MAP_WRITE : FILE_MAP_READ), 0, 0, size));
+	
+	if(_data == NULL)
+	{
+		if(_mapping != NULL)
+			CloseHandle(_mapping);
+		
+		CloseHandle(_file);
+		throw Iex::IoExc("Can't map " + path);
+	}
+	
+	_size = size;
+}
+
+
+MappedFile::~MappedFile()
+{
+	UnmapViewOfFile(_data);
+	CloseHandle(_mapping);
+	CloseHandle(_file);
+}
+
+#else // POSIX
+
+void
+MappedFile::map(const std::string &path, bool write, size_t size)
+{
+	_fd = (write ? open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0666) : open(path.c_str(), O_RDONLY));
+	
+	if(_fd < 0)
+		throw Iex::IoExc("Can't open " + path);
+	
+	if(write)
+	{
+		if(ftruncate(_fd, (off_t)size) != 0)
+		{
+			close(_fd);
+			throw Iex::IoExc("Can't make " + path + " big enough");
+		}
+	}
+	else
+	{
+		struct stat info;
+		
+		if(fstat(_fd, &info) != 0)
+		{
+			close(_fd);
+			throw Iex::IoExc("Can't get the size of " + path);
+		}
+		
+		size = (size_t)info.st_size;
+	}
+	
+	if(size == 0)
+	{
+		close(_fd);
+		throw Iex::IoExc(path + " is empty");
+	}
+	
+	void *data = mmap(NULL, size, (write ? PROT_READ | PROT_WRITE : PROT_READ), MAP_SHARED, _fd, 0);
+	
+	if(data == MAP_FAILED)
+	{
+		close(_fd);
+		throw Iex::IoExc("Can't map " + path);
+	}
+	
+	// frames are read front to back, once
+	if(!write)
+		madvise(data, size, MADV_SEQUENTIAL);
+	
+	_data = (unsigned char *)data;
+	_size = size;
+}
+
+
+MappedFile::~MappedFile()
+{
+	munmap(_data, _size);
+	close(_fd);
+}
+
+#endif
+
+
+void
+MappedFile::prefetch() const
+{
+#ifndef _WIN32
+	madvise(_data, _size, MADV_WILLNEED);
+#endif
+
+	const size_t page_size = 4096;
+	
+	volatile unsigned char sum = 0;
+	
+	for(size_t i=0; i < _size; i += page_size)
+		sum += _data[i];
+	
+	(void)sum;
+}
+
+
+static inline unsigned int
+Read16(const unsigned char *p, bool bigEndian)
+{
+	return (bigEndian ? ((unsigned int)p[0] << 8) | p[1] :
+						((unsigned int)p[1] << 8) | p[0]);
+}
+
+
+static inline unsigned int
+Read32(const unsigned char *p, bool bigEndian)
+{
+	return (bigEndian ? ((unsigned int)p[0] << 24) | ((unsigned int)p[1] << 16) | ((unsigned int)p[2] << 8) | p[3] :
+						((unsigned int)p[3] << 24) | ((unsigned int)p[2] << 16) | ((unsigned int)p[1] << 8) | p[0]);
+}
+
+
+static inline void
+Write16(unsigned char *p, unsigned int value, bool bigEndian)
+{
+	if(bigEndian)
+	{
+		p[0] = (value >> 8) & 0xff;
+		p[1] = value & 0xff;
+	}
+	else
+	{
+		p[0] = value & 0xff;
+		p[1] = (value >> 8) & 0xff;
+	}
+}
+
+
+static inline void
+Write32(unsigned char *p, unsigned int value, bool bigEndian)
+{
+	if(bigEndian)
+	{
+		Write16(p, value >> 16, true);
+		Write16(p + 2, value & 0xffff, true);
+	}
+	else
+	{
+		Write16(p, value & 0xffff, false);
+		Write16(p + 2, value >> 16, false);
+	}
+}
+
+
+size_t
+PackedLayout::dataSize() const
+{
+	return rowBytes * height * (packing == Planar16 ? 3 : 1);
+}
+
+
+PackedLayout
+PackedLayout::Planar(int width, int height, unsigned int maxCode)
+{
+	PackedLayout layout;
+	
+	layout.packing = Planar16;
+	layout.bigEndian = false;
+	layout.maxCode = maxCode;
+	layout.width = width;
+	layout.height = height;
+	layout.offset = 0;
+	layout.rowBytes = (size_t)width * 2;
+	
+	return layout;
+}
+
+
+PackedLayout
+ReadDPXLayout(const unsigned char *data, size_t size)
+{
+	// SMPTE 268M: a 768 byte file header, then the image header with the
+	// first image element at 780
+	if(size < 820)
+		throw Iex::InputExc("Too small to be a DPX file.");
+	
+	const unsigned int magic = Read32(data, true);
+	
+	if(magic != 0x53445058 && magic != 0x58504453) // SDPX or XPDS
+		throw Iex::InputExc("Not a DPX file.");
+	
+	const bool big = (magic == 0x53445058);
+	
+	if(Read16(data + 770, big) < 1)
+		throw Iex::InputExc("DPX file has no image elements.");
+	
+	const unsigned int descriptor = data[800];
+	const unsigned int depth = data[803];
+	const unsigned int packing = Read16(data + 804, big);
+	const unsigned int encoding = Read16(data + 806, big);
+	const unsigned int element_offset = Read32(data + 808, big);
+	const unsigned int eol_padding = Read32(data + 812, big);
+	
+	if(descriptor != 50)
+		throw Iex::InputExc("Only RGB DPX files are supported.");
+	
+	if(encoding != 0)
+		throw Iex::InputExc("Run-length encoded DPX files are not supported.");
+	
+	PackedLayout layout;
+	
+	if(depth == 10 && packing == 1)
+	{
+		layout.packing = PackedLayout::RGB10;
+		layout.maxCode = 1023;
+	}
+	else if(depth == 16 && packing <= 1)
+	{
+		layout.packing = PackedLayout::RGB16;
+		layout.maxCode = 65535;
+	}
+	else
+		throw Iex::InputExc("Only 10-bit filled and 16-bit DPX files are supported.");
+	
+	layout.bigEndian = big;
+	layout.width = (int)Read32(data + 772, big);
+	layout.height = (int)Read32(data + 776, big);
+	layout.offset = (element_offset != 0 ? element_offset : Read32(data + 4, big));
+	layout.rowBytes = (size_t)layout.width * (layout.packing == PackedLayout::RGB10 ? 4 : 6) +
+						(eol_padding == 0xffffffff ? 0 : eol_padding);
+	
+	if(layout.width <= 0 || layout.height <= 0)
+		throw Iex::InputExc("DPX file has no pixels.");
+	
+	if(layout.offset > size || layout.dataSize() > size - layout.offset)
+		throw Iex::InputExc("DPX file is truncated.");
+	
+	return layout;
+}
+
+
+PackedConverter::PackedConverter(ThreadPool &pool) :
+	_pool(pool)
+{
+
+}
+
+
+// pixels at a time, so the float buffer stays in L1
+static const int ChunkSize = 256;
+
+
+static void
+Unpack(const unsigned char *data, const PackedLayout &layout, int y, int x, int count, float *out)
+{
+	const float scale = 1.f / (float)layout.maxCode;
+	
+	const bool big = layout.bigEndian;
+	
+	const unsigned char *row = data + layout.offset + ((size_t)y * layout.rowBytes);
+	
+	if(layout.packing == PackedLayout::RGB10)
+	{
+		const unsigned char *pix = row + ((size_t)x * 4);
+		
+		for(int i=0; i < count; i++)
+		{
+			const unsigned int word = Read32(pix, big);
+			
+			out[0] = (float)((word >> 22) & 0x3ff) * scale;
+			out[1] = (float)((word >> 12) & 0x3ff) * scale;
+			out[2] = (float)((word >>  2) & 0x3ff) * scale;
+			
+			pix += 4;
+			out += 3;
+		}
+	}
+	else if(layout.packing == PackedLayout::RGB16)
+	{
+		const unsigned char *pix = row + ((size_t)x * 6);
+		
+		for(int i=0; i < count; i++)
+		{
+			out[0] = (float)Read16(pix + 0, big) * scale;
+			out[1] = (float)Read16(pix + 2, big) * scale;
+			out[2] = (float)Read16(pix + 4, big) * scale;
+			
+			pix += 6;
+			out += 3;
+		}
+	}
+	else
+	{
+		const size_t plane = layout.rowBytes * layout.height;
+		
+		const unsigned char *pix = row + ((size_t)x * 2);
+		
+		for(int i=0; i < count; i++)
+		{
+			out[0] = (float)Read16(pix, big) * scale;
+			out[1] = (float)Read16(pix + plane, big) * scale;
+			out[2] = (float)Read16(pix + plane * 2, big) * scale;
+			
+			pix += 2;
+			out += 3;
+		}
+	}
+}
+
+
+static void
+Pack(const unsigned short *codes, int count, unsigned char *data, const PackedLayout &layout, int y, int x)
+{
+	const bool big = layout.bigEndian;
+	
+	unsigned char *row = data + layout.offset + ((size_t)y * layout.rowBytes);
+	
+	if(layout.packing == PackedLayout::RGB10)
+	{
+		unsigned char *pix = row + ((size_t)x * 4);
+		
+		for(int i=0; i < count; i++)
+		{
+			Write32(pix, ((unsigned int)codes[0] << 22) | ((unsigned int)codes[1] << 12) | ((unsigned int)codes[2] << 2), big);
+			
+			codes += 3;
+			pix += 4;
+		}
+	}
+	else if(layout.packing == PackedLayout::RGB16)
+	{
+		unsigned char *pix = row + ((size_t)x * 6);
+		
+		for(int i=0; i < count; i++)
+		{
+			Write16(pix + 0, codes[0], big);
+			Write16(pix + 2, codes[1], big);
+			Write16(pix + 4, codes[2], big);
+			
+			codes += 3;
+			pix += 6;
+		}
+	}
+	else
+	{
+		const size_t plane = layout.rowBytes * layout.height;
+		
+		unsigned char *pix = row + ((size_t)x * 2);
+		
+		for(int i=0; i < count; i++)
+		{
+			Write16(pix, codes[0], big);
+			Write16(pix + plane, codes[1], big);
+			Write16(pix + plane * 2, codes[2], big);
+			
+			codes += 3;
+			pix += 2;
+		}
+	}
+}
+
+
+static void
+CheckLayout(const PackedLayout &layout)
+{
+	const unsigned int most = (layout.packing == PackedLayout::RGB10 ? 1023 : 65535);
+	
+	if(layout.maxCode == 0 || layout.maxCode > most)
+		throw Iex::ArgExc("Maximum code value doesn't fit the packing.");
+	
+	if(layout.width <= 0 || layout.height <= 0)
+		throw Iex::ArgExc("Image has no pixels.");
+}
+
+
+void
+PackedConverter::convert(const DCIconverterBase &converter,
+							const unsigned char *in, const PackedLayout &inLayout,
+							unsigned char *out, const PackedLayout &outLayout) const
+{
+	CheckLayout(inLayout);
+	CheckLayout(outLayout);
+	
+	if(inLayout.width != outLayout.width || inLayout.height != outLayout.height)
+		throw Iex::ArgExc("Input and output images are different sizes.");
+	
+	const ForwardDCIconverter *dcdm = (outLayout.maxCode == DCDMencoder::MAX_CODE ?
+										dynamic_cast<const ForwardDCIconverter *>(&converter) : NULL);
+	
+	const int width = inLayout.width;
+	
+	const float max = (float)outLayout.maxCode;
+	
+	_pool.parallelFor(inLayout.height, [&](size_t y)
+	{
+		const ConverterTrace::Span span("row", "packed", y);
+		
+		float buf[ChunkSize * 3];
+		unsigned short codes[ChunkSize * 3];
+		
+		for(int x=0; x < width; x += ChunkSize)
+		{
+			const int count = (width - x < ChunkSize ? width - x : ChunkSize);
+			
+			Unpack(in, inLayout, (int)y, x, count, buf);
+			
+			if(dcdm != NULL)
+			{
+				dcdm->convertSpanDCDM(buf, codes, count);
+			}
+			else
+			{
+				converter.convertSpan(buf, buf, count);
+				
+				for(int i=0; i < count * 3; i++)
+				{
+					const float val = (buf[i] >= 1.f ? 1.f : buf[i] <= 0.f ? 0.f : buf[i]);
+					
+					codes[i] = (val * max) + 0.5f;
+				}
+			}
+			
+			Pack(codes, count, out, outLayout, (int)y, x);
+		}
+	});
+}
@@ -0,0 +1,139 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Packed.h
+//
+// Converting DPX and raw planar frames in memory-mapped files
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_PACKED_H
+#define INCLUDED_DCI_CONVERTER_PACKED_H
+
+
+#include "DCIconverter.h"
+#include "DCIconverter_ThreadPool.h"
+
+#include <string>
+
+
+// A whole file mapped into memory.  Throws Iex::IoExc if it can't be.
+class MappedFile
+{
+  public:
+	// read only
+	MappedFile(const std::string &path);
+	
+	// read and write, the file is created or truncated to size bytes
+	MappedFile(const std::string &path, size_t size);
+	
+	~MappedFile();
+	
+	const unsigned char *data() const { return _data; }
+	unsigned char *data() { return _data; }
+	size_t size() const { return _size; }
+	
+	// Fault every page in now, so the disk reads happen here and not
+	// wherever the data is first touched.
+	void prefetch() const;
+	
+  private:
+	unsigned char *_data;
+	size_t _size;
+	
+#ifdef _WIN32
+	void *_file;
+	void *_mapping;
+#else
+	int _fd;
+#endif
+	
+	void map(const std::string &path, bool write, size_t size);
+	
+	MappedFile(const MappedFile &);
+	MappedFile &operator=(const MappedFile &);
+};
+
+
+// Where the RGB code values are in a block of memory and how they're packed
+typedef struct PackedLayout {
+	typedef enum {
+		RGB10,		// DPX 10-bit filled to 32-bit words (method A), R in the top bits
+		RGB16,		// interleaved 16-bit words
+		Planar16	// a plane of 16-bit words for each of R, G and B
+	} Packing;
+	
+	Packing packing;
+	bool bigEndian;
+	unsigned int maxCode; // 1023, 4095, 65535...
+	int width;
+	int height;
+	size_t offset;		// bytes from the start of the file to the first pixel
+	size_t rowBytes;	// including any padding, one plane's worth for Planar16
+	
+	// bytes from the first pixel to the end of the last one
+	size_t dataSize() const;
+	
+	// Planar16 with no header, the way dciconvert writes raw12
+	static PackedLayout Planar(int width, int height, unsigned int maxCode);
+} PackedLayout;
+
+
+// Reads the layout of a DPX file's first image element, which has to be
+// uncompressed RGB at 10 bits (filled, method A) or 16 bits.  Either byte
+// order.  Throws Iex::InputExc for anything else.
+PackedLayout ReadDPXLayout(const unsigned char *data, size_t size);
+
+
+// Converts packed integer frames without making a float copy of them.  Each
+// row is unpacked a few hundred pixels at a time into a buffer that stays in
+// L1, run through the converter's float convertSpan() (the SIMD kernels) and
+// packed straight into the output, so the frame itself is only read once and
+// written once.  in and out can be the same memory if the layouts match.
+// Going forward with 12-bit output, codes come from the DCDM encoder.
+
+class PackedConverter
+{
+  public:
+	PackedConverter(ThreadPool &pool = ThreadPool::Global());
+	
+	// in and out point to the start of the file, the layouts say where the pixels are
+	void convert(const DCIconverterBase &converter,
+					const unsigned char *in, const PackedLayout &inLayout,
+					unsigned char *out, const PackedLayout &outLayout) const;
+	
+  private:
+	ThreadPool &_pool;
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_PACKED_H
@@ -0,0 +1,341 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Reference.cpp
+//
+// Double precision conversions, to check the fast paths against
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Reference.h"
+
+#include <assert.h>
+#include <math.h>
+
+
+static const double NormalizeScale = 48.0 / 52.37;
+
+
+ReferenceDCIconverter::ReferenceDCIconverter(bool forward, ResponseCurve curve, double gamma,
+												ColorSpace color, ChromaticAdaptation adapt, int temperature,
+												bool normalize, double xyz_gamma) :
+	DCIconverterBase(),
+	_forward(forward),
+	_curve(curve),
+	_gamma(gamma),
+	_normalize(normalize),
+	_xyz_gamma(xyz_gamma),
+	_rgb2xyz_matrix( RGBtoXYZmatrixD(color, adapt, temperature) ),
+	_xyz2rgb_matrix( _rgb2xyz_matrix.inverse() )
+{
+	// so anybody looking at the float matrix sees the right thing
+	for(int i=0; i < 3; i++)
+		for(int j=0; j < 3; j++)
+			DCIconverterBase::_rgb2xyz_matrix[i][j] = _rgb2xyz_matrix[i][j];
+}
+
+
+static inline double
+GammaFuncD(double in, double gamma)
+{
+	return (in < 0.0 ? -pow(-in, gamma) : pow(in, gamma) );
+}
+
+
+static inline double
+Clamp01(double in)
+{
+	return (in >= 1.0 ? 1.0 : in <= 0.0 ? 0.0 : in);
+}
+
+
+double
+ReferenceDCIconverter::Linearize(ResponseCurve curve, double gamma, double in)
+{
+	switch(curve)
+	{
+		case sRGB:			return (in <= 0.04045 ? (in / 12.92) : pow( (in + 0.055) / 1.055, 2.4));
+		case Rec709:		return (in <= 0.081 ? (in / 4.5) : pow( (in + 0.099) / 1.099, 1.0 / 0.45));
+		case ProPhotoRGB:	return (in < 0.031248 ? (in / 16.0) : pow(in, 1.8));
+		case P3:			return GammaFuncD(in, 2.6);
+		case Gamma:			return GammaFuncD(in, gamma);
+		default:
+			assert(curve == Linear);
+			return in;
+	}
+}
+
+
+double
+ReferenceDCIconverter::Delinearize(ResponseCurve curve, double gamma, double in)
+{
+	switch(curve)
+	{
+		case sRGB:			return (in <= 0.0031308 ? (in * 12.92) : 1.055 * pow(in, 1.0 / 2.4) - 0.055);
+		case Rec709:		return (in <= 0.018 ? (in * 4.5) : 1.099 * pow(in, 0.45) - 0.099);
+		case ProPhotoRGB:	return (in < 0.001953 ? (in * 16.0) : pow(in, 1.0 / 1.8));
+		case P3:			return GammaFuncD(in, 1.0 / 2.6);
+		case Gamma:			return GammaFuncD(in, 1.0 / gamma);
+		default:
+			assert(curve == Linear);
+			return in;
+	}
+}
+
+
+void
+ReferenceDCIconverter::convert(const double in[3], double out[3]) const
+{
+	if(_forward)
+	{
+		XYZvalueD rgb;
+		
+		for(int c=0; c < 3; c++)
+			rgb[c] = Linearize(_curve, _gamma, in[c]);
+		
+		XYZvalueD xyz = rgb * _rgb2xyz_matrix;
+		
+		for(int c=0; c < 3; c++)
+			out[c] = GammaFuncD(_normalize ? xyz[c] * NormalizeScale : xyz[c], 1.0 / _xyz_gamma);
+	}
+	else
+	{
+		XYZvalueD xyz;
+		
+		for(int c=0; c < 3; c++)
+		{
+			xyz[c] = GammaFuncD(in[c], _xyz_gamma);
+			
+			if(_normalize)
+				xyz[c] /= NormalizeScale;
+		}
+		
+		XYZvalueD rgb = xyz * _xyz2rgb_matrix;
+		
+		for(int c=0; c < 3; c++)
+			out[c] = Delinearize(_curve, _gamma, rgb[c]);
+	}
+}
+
+
+Pixel
+ReferenceDCIconverter::convert(const Pixel &pix) const
+{
+	const double in[3] = { pix[0], pix[1], pix[2] };
+	
+	double out[3];
+	
+	convert(in, out);
+	
+	return Pixel(out[0], out[1], out[2]);
+}
+
+
+void
+ReferenceDCIconverter::outputToXYZ(const double out[3], double xyz[3]) const
+{
+	if(_forward)
+	{
+		// X'Y'Z' to XYZ
+		for(int c=0; c < 3; c++)
+		{
+			xyz[c] = pow(Clamp01(out[c]), _xyz_gamma);
+			
+			if(_normalize)
+				xyz[c] /= NormalizeScale;
+		}
+	}
+	else
+	{
+		// R'G'B' to XYZ
+		XYZvalueD rgb;
+		
+		for(int c=0; c < 3; c++)
+			rgb[c] = Linearize(_curve, _gamma, Clamp01(out[c]));
+		
+		const XYZvalueD val = rgb * _rgb2xyz_matrix;
+		
+		xyz[0] = val.x;
+		xyz[1] = val.y;
+		xyz[2] = val.z;
+	}
+}
+
+
+void
+ReferenceDCIconverter::whiteXYZ(double xyz[3]) const
+{
+	const XYZvalueD val = XYZvalueD(1.0, 1.0, 1.0) * _rgb2xyz_matrix;
+	
+	xyz[0] = val.x;
+	xyz[1] = val.y;
+	xyz[2] = val.z;
+}
+
+
+ReferenceDCIconverter::XYZvalueD
+ReferenceDCIconverter::TemperatureToWhiteD(int temperature)
+{
+	// Little CMS cmswtpnt.c, see DCIconverterBase::TemperatureToWhite()
+	const double T = temperature;
+	const double T2 = T * T;
+	const double T3 = T2 * T;
+	
+	double x;
+	
+	if(T >= 4000.0 && T <= 7000.0)
+	{
+		x = -4.6070*(1E9/T3) + 2.9678*(1E6/T2) + 0.09911*(1E3/T) + 0.244063;
+	}
+	else if (T > 7000.0 && T <= 25000.0)
+	{
+		x = -2.0064*(1E9/T3) + 1.9018*(1E6/T2) + 0.24748*(1E3/T) + 0.237040;
+	}
+	else
+		throw Iex::LogicExc("Invalid temperature");
+	
+	const double y = -3.000*(x*x) + 2.870*x - 0.275;
+	
+	return XYZvalueD((1.0 / y) * x, 1.0, (1.0 / y) * (1 - x - y));
+}
+
+
+static inline ReferenceDCIconverter::XYZvalueD
+xyYtoXYZ(double x, double y)
+{
+	return ReferenceDCIconverter::XYZvalueD((1.0 / y) * x, 1.0, (1.0 / y) * (1 - x - y));
+}
+
+
+ReferenceDCIconverter::MatrixD
+ReferenceDCIconverter::RGBtoXYZmatrixD(ColorSpace color, const XYZvalueD *endWhite)
+{
+	// Spec values and steps are the same as DCIconverterBase::RGBtoXYZmatrix()
+	
+	static const MatrixD sRGBtoXYZ_spec
+		(0.4124, 0.3576, 0.1805,
+		 0.2126, 0.7152, 0.0722,
+		 0.0193, 0.1192, 0.9505);
+	
+	static const MatrixD XYZtoProPhotoRGB_spec
+		(1.3460, -0.2556, -0.0511,
+		-0.5446,  1.5082,  0.0205,
+		 0.0000,  0.0000,  1.2123);
+	
+	static const double P3_r_x = 0.680;	static const double P3_r_y = 0.320;
+	static const double P3_g_x = 0.265;	static const double P3_g_y = 0.690;
+	static const double P3_b_x = 0.150;	static const double P3_b_y = 0.060;
+	static const double P3_w_x = 0.314;	static const double P3_w_y = 0.351;
+	
+	static const MatrixD P3_chromaticity_mat
+		(P3_r_x, P3_g_x, P3_b_x,
+		 P3_r_y, P3_g_y, P3_b_y,
+		 1.0 - P3_r_x - P3_r_y, 1.0 - P3_g_x - P3_g_y, 1.0 - P3_b_x - P3_b_y);
+	
+	static const XYZvalueD P3_RGB_XYZ_sum = xyYtoXYZ(P3_w_x, P3_w_y) * P3_chromaticity_mat.transposed().inverse();
+	
+	static const MatrixD P3_RGB_XYZ_sum_mat
+		(P3_RGB_XYZ_sum[0], 0,        0,       
+		 0,        P3_RGB_XYZ_sum[1], 0,       
+		 0,        0,        P3_RGB_XYZ_sum[2]);
+	
+	static const MatrixD P3toXYZ_spec = P3_chromaticity_mat * P3_RGB_XYZ_sum_mat;
+	
+	static const MatrixD bradfordCPM_spec
+		(0.895100,  0.266400, -0.161400,
+		-0.750200,  1.713500,  0.036700,
+		 0.038900, -0.068500,  1.029600);
+	
+	static const MatrixD inverseBradfordCPM_spec
+		(0.986993, -0.147054,  0.159963,
+		 0.432305,  0.518360,  0.049291,
+		-0.008529,  0.040043,  0.968487);
+	
+	
+	// row vectors, so transposed
+	static const MatrixD sRGBtoXYZ = sRGBtoXYZ_spec.transposed();
+	static const MatrixD ProPhotoRGBtoXYZ = XYZtoProPhotoRGB_spec.inverse().transposed();
+	static const MatrixD P3toXYZ = P3toXYZ_spec.transposed();
+	static const MatrixD bradfordCPM = bradfordCPM_spec.transposed();
+	static const MatrixD inverseBradfordCPM = inverseBradfordCPM_spec.transposed();
+	
+	
+	const MatrixD RGBtoXYZ = (color == ProPhotoRGB_ROMM ? ProPhotoRGBtoXYZ :
+								color == P3_RGB ? P3toXYZ :
+								sRGBtoXYZ );
+	
+	if(endWhite == NULL)
+		return RGBtoXYZ;
+	
+	
+	const XYZvalueD white = (color == ProPhotoRGB_ROMM ? xyYtoXYZ(0.3457, 0.3585) :
+								color == P3_RGB ? xyYtoXYZ(P3_w_x, P3_w_y) :
+								xyYtoXYZ(0.3127, 0.3290) );
+	
+	// same shortcut as the float version, the spec matrices only invert to 6 digits
+	if( endWhite->equalWithAbsError(white, 1e-5) )
+		return RGBtoXYZ;
+	
+	const XYZvalueD ratio( (*endWhite * bradfordCPM) / (white * bradfordCPM) );
+	
+	const MatrixD ratioMat
+		(ratio[0], 0,        0,       
+		 0,        ratio[1], 0,       
+		 0,        0,        ratio[2]);
+	
+	return RGBtoXYZ * (bradfordCPM * ratioMat * inverseBradfordCPM);
+}
+
+
+ReferenceDCIconverter::MatrixD
+ReferenceDCIconverter::RGBtoXYZmatrixD(ColorSpace color, ChromaticAdaptation adapt, int temperature)
+{
+	if(adapt == None)
+		return RGBtoXYZmatrixD(color, NULL);
+	
+	XYZvalueD white;
+	
+	switch(adapt)
+	{
+		case Temp:	white = TemperatureToWhiteD(temperature);	break;
+		case D50:	white = xyYtoXYZ(0.3457, 0.3585);			break;
+		case D55:	white = xyYtoXYZ(0.3324, 0.3474);			break;
+		case D60:	white = xyYtoXYZ(0.3217, 0.3378);			break;
+		case DCI:	white = xyYtoXYZ(0.314, 0.351);				break;
+		default:
+			assert(adapt == D65);
+			white = xyYtoXYZ(0.3127, 0.3290);
+	}
+	
+	return RGBtoXYZmatrixD(color, &white);
+}
@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Reference.h
+//
+// Double precision conversions, to check the fast paths against
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_REFERENCE_H
+#define INCLUDED_DCI_CONVERTER_REFERENCE_H
+
+
+#include "DCIconverter.h"
+
+
+// The same conversion as Forward/ReverseDCIconverter done entirely in double,
+// with no tables, kernels or fixed point.  The matrices are built from the
+// same spec values as DCIconverterBase::RGBtoXYZmatrix, but in double from
+// start to finish (the P3 chromaticities included), so the only differences
+// from the float converters are the float math and the shortcuts.
+//
+// Slow.  It's meant for auditing, not rendering.
+
+class ReferenceDCIconverter : public DCIconverterBase
+{
+  public:
+	ReferenceDCIconverter(bool forward, ResponseCurve curve, double gamma,
+							ColorSpace color, ChromaticAdaptation adapt, int temperature,
+							bool normalize, double xyz_gamma);
+	
+	virtual ~ReferenceDCIconverter() {}
+	
+	// rounded to float at the very end
+	virtual Pixel convert(const Pixel &pix) const;
+	
+	void convert(const double in[3], double out[3]) const;
+	
+	// The absolute (un-normalized) linear XYZ that an output value of this
+	// conversion stands for, so outputs can be compared as colors.  Output
+	// values are clamped to 0-1 first, like they would be when stored.
+	void outputToXYZ(const double out[3], double xyz[3]) const;
+	
+	// XYZ of RGB 1,1,1 (Y is 1), the white for Lab comparisons
+	void whiteXYZ(double xyz[3]) const;
+	
+	bool forward() const { return _forward; }
+	
+	
+	typedef Imath::M33d MatrixD;
+	typedef Imath::V3d XYZvalueD;
+	
+	static XYZvalueD TemperatureToWhiteD(int temperature);
+	
+	static MatrixD RGBtoXYZmatrixD(ColorSpace color, ChromaticAdaptation adapt, int temperature);
+	
+	// R'G'B' to linear RGB and back for one channel
+	static double Linearize(ResponseCurve curve, double gamma, double in);
+	static double Delinearize(ResponseCurve curve, double gamma, double in);
+	
+  private:
+	const bool _forward;
+	const ResponseCurve _curve;
+	const double _gamma;
+	const bool _normalize;
+	const double _xyz_gamma;
+	const MatrixD _rgb2xyz_matrix;
+	const MatrixD _xyz2rgb_matrix;
+	
+	static MatrixD RGBtoXYZmatrixD(ColorSpace color, const XYZvalueD *endWhite);
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_REFERENCE_H
@@ -0,0 +1,695 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_SIMD.cpp
+//
+// Lowers conversions to plans and picks a vector kernel for the CPU we're running on
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_SIMD.h"
+#include "DCIconverter_Stats.h"
+
+#include <math.h>
+#include <string.h>
+
+#if DCI_SIMD_X86 && defined(_MSC_VER)
+	#include <intrin.h>
+	#include <immintrin.h>
+#endif
+
+
+#if DCI_SIMD_X86
+
+#ifdef _MSC_VER
+
+static bool
+CPUsupports(bool avx512)
+{
+	int info[4];
+	
+	__cpuid(info, 0);
+	
+	if(info[0] < 7)
+		return false;
+	
+	__cpuid(info, 1);
+	
+	const bool fma = (info[2] & (1 << 12)) != 0;
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	
+	if(!fma || !osxsave || !avx)
+		return false;
+	
+	// the OS has to be saving the YMM (and for AVX-512, ZMM) registers
+	const unsigned long long xcr0 = _xgetbv(0);
+	
+	if((xcr0 & 0x06) != 0x06)
+		return false;
+	
+	__cpuidex(info, 7, 0);
+	
+	if(avx512)
+		return ((info[1] & (1 << 16)) != 0) && ((xcr0 & 0xe6) == 0xe6);
+	else
+		return (info[1] & (1 << 5)) != 0;
+}
+
+
+static bool
+CPUsupportsF16C()
+{
+	int info[4];
+	
+	__cpuid(info, 1);
+	
+	const bool osxsave = (info[2] & (1 << 27)) != 0;
+	const bool avx = (info[2] & (1 << 28)) != 0;
+	const bool f16c = (info[2] & (1 << 29)) != 0;
+	
+	return osxsave && avx && f16c && ((_xgetbv(0) & 0x06) == 0x06);
+}
+
+#else
+
+static bool
+CPUsupports(bool avx512)
+{
+	if(avx512)
+		return __builtin_cpu_supports("avx512f");
+	else
+		return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+}
+
+
+static bool
+CPUsupportsF16C()
+{
+	return __builtin_cpu_supports("avx") && __builtin_cpu_supports("f16c");
+}
+
+#endif // _MSC_VER
+
+#endif // DCI_SIMD_X86
+
+
+namespace {
+
+// The vector kernel with one lane, for CPUs without AVX2.
+// Compilers are free to vectorize the loops anyway.
+struct VecScalar
+{
+	typedef float	F;
+	typedef int		I;
+	typedef bool	M;
+	
+	enum { Lanes = 1 };
+	
+	static inline F set1(float v) { return v; }
+	static inline I seti(int v) { return v; }
+	static inline F loadu(const float *p) { return *p; }
+	static inline void storeu(float *p, F v) { *p = v; }
+	
+	static inline F add(F a, F b) { return a + b; }
+	static inline F sub(F a, F b) { return a - b; }
+	static inline F mul(F a, F b) { return a * b; }
+	static inline F div(F a, F b) { return a / b; }
+	static inline F fmadd(F a, F b, F c) { return a * b + c; }
+	static inline F max(F a, F b) { return (a > b ? a : b); }
+	static inline F round(F a) { return rintf(a); }
+	
+	static inline M le(F a, F b) { return a <= b; }
+	static inline M lt(F a, F b) { return a < b; }
+	static inline M eq_i(I a, I b) { return a == b; }
+	static inline F select(M m, F a, F b) { return (m ? a : b); }
+	
+	// unsigned, so shifts and wraparound are defined
+	static inline I and_i(I a, I b) { return a & b; }
+	static inline I or_i(I a, I b) { return a | b; }
+	static inline I add_i(I a, I b) { return (I)((unsigned int)a + (unsigned int)b); }
+	static inline I sub_i(I a, I b) { return (I)((unsigned int)a - (unsigned int)b); }
+	static inline I srl23(I a) { return (I)((unsigned int)a >> 23); }
+	static inline I sll23(I a) { return (I)((unsigned int)a << 23); }
+	
+	static inline I asint(F a) { I i; memcpy(&i, &a, sizeof(i)); return i; }
+	static inline F asfloat(I a) { F f; memcpy(&f, &a, sizeof(f)); return f; }
+	static inline F itof(I a) { return (F)a; }
+	static inline I ftoi(F a) { return (I)rintf(a); }
+};
+
+} // namespace
+
+
+#include "DCIconverter_SIMDkernel.h"
+
+
+void
+DCIkernel_Scalar(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	VecKernel<VecScalar>(params, r, g, b, count);
+}
+
+
+void
+DCIstageKernel_Scalar(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count)
+{
+	VecStageKernel<VecScalar>(params, stage, r, g, b, count);
+}
+
+
+typedef struct {
+	DCIkernelFunc		kernel;
+	DCIstageKernelFunc	stage_kernel;
+	size_t				lanes;
+} KernelChoice;
+
+
+static KernelChoice
+ChooseKernel()
+{
+	KernelChoice choice = { NULL, NULL, 1 };
+	
+#if DCI_SIMD_X86
+	if( CPUsupports(true) )
+	{
+		choice.kernel = DCIkernel_AVX512;
+		choice.stage_kernel = DCIstageKernel_AVX512;
+		choice.lanes = 16;
+	}
+	else if( CPUsupports(false) )
+	{
+		choice.kernel = DCIkernel_AVX2;
+		choice.stage_kernel = DCIstageKernel_AVX2;
+		choice.lanes = 8;
+	}
+#endif
+
+	return choice;
+}
+
+
+DCIkernelFunc
+DCIgetKernel(size_t *lanes, DCIstageKernelFunc *stage_kernel)
+{
+	static const KernelChoice choice = ChooseKernel();
+	
+	if(lanes)
+		*lanes = choice.lanes;
+	
+	if(stage_kernel)
+		*stage_kernel = choice.stage_kernel;
+	
+	return choice.kernel;
+}
+
+
+void
+DCIlowerPlan(const DCIkernelParams &params, DCIplan &plan)
+{
+	plan.params = params;
+	plan.stages = 0;
+	
+	DCIkernelParams &lowered = plan.params;
+	
+	// a Gamma curve of 1.0 is as linear as Linear
+	if(lowered.curve == DCIconverterBase::Gamma && lowered.gamma == 1.f)
+		lowered.curve = DCIconverterBase::Linear;
+	
+	if(lowered.curve != DCIconverterBase::Linear)
+		plan.stages |= DCI_STAGE_CURVE;
+	
+	if(lowered.xyz_gamma != 1.f)
+		plan.stages |= DCI_STAGE_XYZ_GAMMA;
+	
+	
+	// Normalization is a uniform scale, so it commutes with the matrix.
+	// Forward scales the matrix's output and reverse its input, either way
+	// it's every element times the scale.
+	bool identity = true;
+	
+	for(int i=0; i < 3; i++)
+	{
+		for(int j=0; j < 3; j++)
+		{
+			lowered.matrix[i][j] *= params.scale;
+			
+			identity = identity && (lowered.matrix[i][j] == (i == j ? 1.f : 0.f));
+		}
+	}
+	
+	lowered.scale = 1.f;
+	
+	if(!identity)
+		plan.stages |= DCI_STAGE_MATRIX;
+}
+
+
+static void
+MatrixSpan(const float *in, size_t inStride, float *out, size_t outStride, size_t count,
+			const float m[3][3])
+{
+	// in registers, so the compiler doesn't reload them after every store in case out aliases m
+	const float m00 = m[0][0], m01 = m[0][1], m02 = m[0][2];
+	const float m10 = m[1][0], m11 = m[1][1], m12 = m[1][2];
+	const float m20 = m[2][0], m21 = m[2][1], m22 = m[2][2];
+	
+	for(size_t i=0; i < count; i++)
+	{
+		const float r = in[0];
+		const float g = in[1];
+		const float b = in[2];
+		
+		out[0] = r * m00 + g * m10 + b * m20;
+		out[1] = r * m01 + g * m11 + b * m21;
+		out[2] = r * m02 + g * m12 + b * m22;
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+static void
+CopySpan(const float *in, size_t inStride, float *out, size_t outStride, size_t count)
+{
+	if(in == out && inStride == outStride)
+		return;
+	
+	for(size_t i=0; i < count; i++)
+	{
+		out[0] = in[0];
+		out[1] = in[1];
+		out[2] = in[2];
+		
+		in += inStride;
+		out += outStride;
+	}
+}
+
+
+// SIMD if we have it, otherwise the scalar kernel for the approximations,
+// leaving Exact to the converters' own libm loops
+static DCIkernelFunc
+KernelFor(const DCIkernelParams &params, size_t *lanes, DCIstageKernelFunc *stage_kernel)
+{
+	const DCIkernelFunc kernel = DCIgetKernel(lanes, stage_kernel);
+	
+	if(kernel != NULL || params.precision == DCIconverterBase::Exact)
+		return kernel;
+	
+	*lanes = VecScalar::Lanes;
+	*stage_kernel = DCIstageKernel_Scalar;
+	
+	return DCIkernel_Scalar;
+}
+
+
+// Stages that take a power of whatever comes in, negative values included.
+// The other curves send negatives down their linear segment.
+static bool
+HasSignPath(const DCIkernelParams &params, DCIplanStage stage)
+{
+	if(stage == DCI_STAGE_XYZ_GAMMA)
+		return true;
+	else if(stage == DCI_STAGE_CURVE)
+		return (params.curve == DCIconverterBase::P3 || params.curve == DCIconverterBase::Gamma);
+	else
+		return false;
+}
+
+
+// The fused kernel, unless instruments are on.  Then the stages run one at
+// a time, in the plan's order, each booked to its own stage, and values
+// about to go through a power's sign path are counted on the way in.
+static void
+RunKernel(const DCIplan &plan, DCIkernelFunc kernel, DCIstageKernelFunc stage_kernel,
+			float *r, float *g, float *b, size_t count,
+			ConverterInstruments::StageTimer &timer)
+{
+	const DCIkernelParams &params = plan.params;
+	
+	if( !timer.running() )
+	{
+		kernel(params, r, g, b, count);
+		return;
+	}
+	
+	static const DCIplanStage forward_order[3] = { DCI_STAGE_CURVE, DCI_STAGE_MATRIX, DCI_STAGE_XYZ_GAMMA };
+	static const DCIplanStage reverse_order[3] = { DCI_STAGE_XYZ_GAMMA, DCI_STAGE_MATRIX, DCI_STAGE_CURVE };
+	static const StatsStage booked[3] = { STATS_DECODE, STATS_MATRIX, STATS_ENCODE };
+	
+	const DCIplanStage *order = (params.forward ? forward_order : reverse_order);
+	
+	// the fused kernel applies even an identity matrix, so this does too
+	const unsigned int stages = (plan.stages | DCI_STAGE_MATRIX);
+	
+	const float *const planes[3] = { r, g, b };
+	
+	for(int s=0; s < 3; s++)
+	{
+		if( !(stages & order[s]) )
+			continue;
+		
+		if( HasSignPath(params, order[s]) )
+			ConverterInstruments::CountSignPath(planes, count);
+		
+		stage_kernel(params, order[s], r, g, b, count);
+		
+		timer.lap(booked[s]);
+	}
+}
+
+
+bool
+DCIplanConvertSpan(const DCIplan &plan,
+					const float *in, float *out, size_t count,
+					size_t inStride, size_t outStride)
+{
+	const DCIkernelParams &params = plan.params;
+	
+	// Without curves there's no reason to deinterleave, one pass over the
+	// pixels is quicker than the two copies around a kernel.
+	if(plan.stages == 0)
+	{
+		CopySpan(in, inStride, out, outStride, count);
+		return true;
+	}
+	else if(plan.stages == DCI_STAGE_MATRIX)
+	{
+		ConverterInstruments::Timer timer(STATS_MATRIX);
+		
+		MatrixSpan(in, inStride, out, outStride, count, params.matrix);
+		return true;
+	}
+	
+	
+	size_t lanes = 1;
+	DCIstageKernelFunc stage_kernel = NULL;
+	
+	const DCIkernelFunc kernel = KernelFor(params, &lanes, &stage_kernel);
+	
+	if(kernel == NULL)
+		return false;
+	
+	// the copies in and out are booked with the stage next to them
+	ConverterInstruments::StageTimer timer;
+	
+	
+	// Kernels want planar data, so we deinterleave a block at a time.
+	// The block is a multiple of every lane count, only the last one needs padding.
+	const size_t block_size = 256;
+	
+	float r[block_size];
+	float g[block_size];
+	float b[block_size];
+	
+	while(count > 0)
+	{
+		const size_t n = (count < block_size ? count : block_size);
+		
+		const float *pix = in;
+		
+		for(size_t i=0; i < n; i++)
+		{
+			r[i] = pix[0];
+			g[i] = pix[1];
+			b[i] = pix[2];
+			
+			pix += inStride;
+		}
+		
+		const size_t padded = ((n + lanes - 1) / lanes) * lanes;
+		
+		for(size_t i=n; i < padded; i++)
+		{
+			r[i] = g[i] = b[i] = 0.f;
+		}
+		
+		
+		RunKernel(plan, kernel, stage_kernel, r, g, b, padded, timer);
+		
+		
+		float *outpix = out;
+		
+		for(size_t i=0; i < n; i++)
+		{
+			outpix[0] = r[i];
+			outpix[1] = g[i];
+			outpix[2] = b[i];
+			
+			outpix += outStride;
+		}
+		
+		timer.lap(STATS_ENCODE);
+		
+		in += n * inStride;
+		out += n * outStride;
+		count -= n;
+	}
+	
+	return true;
+}
+
+
+static inline void
+CopyPlane(const float *in, size_t inStride, float *out, size_t count)
+{
+	if(inStride == 1)
+	{
+		if(in != out)
+			memmove(out, in, count * sizeof(float));
+	}
+	else
+	{
+		for(size_t i=0; i < count; i++)
+		{
+			out[i] = *in;
+			
+			in += inStride;
+		}
+	}
+}
+
+
+static void
+MatrixPlanar(const float *const in[3], float *const out[3], size_t count,
+				size_t inStride, size_t outStride, const float m[3][3])
+{
+	for(size_t i=0; i < count; i++)
+	{
+		const float r = in[0][i * inStride];
+		const float g = in[1][i * inStride];
+		const float b = in[2][i * inStride];
+		
+		out[0][i * outStride] = r * m[0][0] + g * m[1][0] + b * m[2][0];
+		out[1][i * outStride] = r * m[0][1] + g * m[1][1] + b * m[2][1];
+		out[2][i * outStride] = r * m[0][2] + g * m[1][2] + b * m[2][2];
+	}
+}
+
+
+bool
+DCIplanConvertPlanar(const DCIplan &plan,
+						const float *const in[3], float *const out[3], size_t count,
+						size_t inStride, size_t outStride)
+{
+	const DCIkernelParams &params = plan.params;
+	
+	if(plan.stages == 0)
+	{
+		for(int c=0; c < 3; c++)
+		{
+			if(outStride == 1)
+			{
+				CopyPlane(in[c], inStride, out[c], count);
+			}
+			else if(in[c] != out[c] || inStride != outStride)
+			{
+				for(size_t i=0; i < count; i++)
+					out[c][i * outStride] = in[c][i * inStride];
+			}
+		}
+		
+		return true;
+	}
+	
+	
+	size_t lanes = 1;
+	DCIstageKernelFunc stage_kernel = NULL;
+	
+	const DCIkernelFunc kernel = KernelFor(params, &lanes, &stage_kernel);
+	
+	// Planar data is what the kernels want, so a matrix-only plan still goes
+	// through one if there is one.  It's a single pass either way.
+	if(kernel == NULL && plan.stages == DCI_STAGE_MATRIX)
+	{
+		ConverterInstruments::Timer timer(STATS_MATRIX);
+		
+		MatrixPlanar(in, out, count, inStride, outStride, params.matrix);
+		return true;
+	}
+	
+	if(kernel == NULL)
+		return false;
+	
+	ConverterInstruments::StageTimer timer;
+	
+	
+	// Packed output planes are what the kernels work on, so whole vectors go
+	// straight there, a block at a time so the copy from in is still in cache.
+	// Strided output and the last few pixels go through buffers.
+	const size_t block_size = 256;
+	
+	float r[block_size];
+	float g[block_size];
+	float b[block_size];
+	
+	size_t done = 0;
+	
+	while(done < count)
+	{
+		const size_t n = (count - done < block_size ? count - done : block_size);
+		
+		const size_t whole = (n / lanes) * lanes;
+		
+		if(outStride == 1 && whole > 0)
+		{
+			float *out_r = out[0] + done;
+			float *out_g = out[1] + done;
+			float *out_b = out[2] + done;
+			
+			CopyPlane(in[0] + (done * inStride), inStride, out_r, whole);
+			CopyPlane(in[1] + (done * inStride), inStride, out_g, whole);
+			CopyPlane(in[2] + (done * inStride), inStride, out_b, whole);
+			
+			RunKernel(plan, kernel, stage_kernel, out_r, out_g, out_b, whole, timer);
+			
+			done += whole;
+			continue;
+		}
+		
+		
+		for(size_t i=0; i < n; i++)
+		{
+			const size_t pos = (done + i) * inStride;
+			
+			r[i] = in[0][pos];
+			g[i] = in[1][pos];
+			b[i] = in[2][pos];
+		}
+		
+		const size_t padded = ((n + lanes - 1) / lanes) * lanes;
+		
+		for(size_t i=n; i < padded; i++)
+		{
+			r[i] = g[i] = b[i] = 0.f;
+		}
+		
+		RunKernel(plan, kernel, stage_kernel, r, g, b, padded, timer);
+		
+		for(size_t i=0; i < n; i++)
+		{
+			const size_t pos = (done + i) * outStride;
+			
+			out[0][pos] = r[i];
+			out[1][pos] = g[i];
+			out[2][pos] = b[i];
+		}
+		
+		timer.lap(STATS_ENCODE);
+		
+		done += n;
+	}
+	
+	return true;
+}
+
+
+void
+DCIplanRun(const DCIplan &plan, float *r, float *g, float *b, size_t count)
+{
+	if(plan.stages == 0)
+		return;
+	
+	ConverterInstruments::StageTimer timer;
+	
+	size_t lanes = 1;
+	DCIstageKernelFunc stage_kernel = NULL;
+	
+	const DCIkernelFunc kernel = DCIgetKernel(&lanes, &stage_kernel);
+	
+	const size_t whole = (kernel != NULL ? (count / lanes) * lanes : 0);
+	
+	if(whole > 0)
+		RunKernel(plan, kernel, stage_kernel, r, g, b, whole, timer);
+	
+	if(whole < count)
+		RunKernel(plan, DCIkernel_Scalar, DCIstageKernel_Scalar, r + whole, g + whole, b + whole, count - whole, timer);
+}
+
+
+void
+DCIhalfToFloat(const half *in, float *out, size_t count)
+{
+#if DCI_SIMD_X86
+	static const bool f16c = CPUsupportsF16C();
+	
+	if(f16c)
+	{
+		DCIhalfToFloat_F16C(in, out, count);
+		return;
+	}
+#endif
+
+	for(size_t i=0; i < count; i++)
+		out[i] = in[i];
+}
+
+
+void
+DCIfloatToHalf(const float *in, half *out, size_t count)
+{
+#if DCI_SIMD_X86
+	static const bool f16c = CPUsupportsF16C();
+	
+	if(f16c)
+	{
+		DCIfloatToHalf_F16C(in, out, count);
+		return;
+	}
+#endif
+
+	for(size_t i=0; i < count; i++)
+		out[i] = in[i];
+}
@@ -0,0 +1,151 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_SIMD.h
+//
+// Conversion plans and vectorized kernels (AVX2 and AVX-512)
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_SIMD_H
+#define INCLUDED_DCI_CONVERTER_SIMD_H
+
+
+#include "DCIconverter.h"
+
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+	#define DCI_SIMD_X86 1
+#else
+	#define DCI_SIMD_X86 0
+#endif
+
+
+// Everything a kernel needs to know about a converter.
+// Exponents are the ones actually applied, so they have already been
+// inverted where the converter inverts them.
+struct DCIkernelParams {
+	bool							forward;
+	DCIconverterBase::ResponseCurve	curve;
+	float							gamma;			// P3 and Gamma curves
+	float							matrix[3][3];	// Imath layout, pixel is a row vector
+	float							scale;			// normalization (1.0 for none)
+	float							xyz_gamma;		// 1.0 skips the stage
+	DCIconverterBase::Precision		precision;		// which pow approximation
+};
+
+
+// The stages a conversion can still have once it's been planned.
+// Forward runs them in this order, reverse in the opposite one.
+typedef enum {
+	DCI_STAGE_CURVE		= 1 << 0,	// R'G'B' <-> RGB
+	DCI_STAGE_MATRIX	= 1 << 1,	// RGB <-> XYZ, normalization included
+	DCI_STAGE_XYZ_GAMMA	= 1 << 2	// XYZ <-> X'Y'Z'
+} DCIplanStage;
+
+
+// A conversion lowered to the stages that actually change the pixels.
+// The normalization scale is folded into the matrix, and Linear curves,
+// gammas of 1.0 and an identity matrix are dropped.  Whatever is left runs
+// as one fused pass: a copy, the matrix alone, or a kernel.
+struct DCIplan {
+	DCIkernelParams	params;		// scale is 1.0, dropped stages are set to no-ops
+	unsigned int	stages;		// DCIplanStage bits
+};
+
+
+void DCIlowerPlan(const DCIkernelParams &params, DCIplan &plan);
+
+
+// Kernels work in place on planar data with the scale already in the matrix,
+// which means they only get params from a DCIplan.
+// count must be a multiple of the kernel's lane count.
+typedef void (*DCIkernelFunc)(const DCIkernelParams &params, float *r, float *g, float *b, size_t count);
+
+// The same thing one stage at a time, for instruments to time each stage.
+// Running a plan's stages in order gives the same pixels as its kernel.
+typedef void (*DCIstageKernelFunc)(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count);
+
+
+// Best kernel for this CPU, or NULL if there isn't one.
+// stage_kernel, if given, gets its single-stage counterpart.
+DCIkernelFunc DCIgetKernel(size_t *lanes, DCIstageKernelFunc *stage_kernel = NULL);
+
+
+// Interleaved span conversion.  Plans without curves run without a kernel,
+// the matrix alone in a single pass over the pixels where they are.
+// Otherwise it's the best kernel, and without a SIMD kernel the
+// approximate precisions still go through the same code compiled for
+// scalars, so the result doesn't depend on the CPU much.
+// Returns false if there is no kernel for the job (no SIMD and Exact
+// precision, which is libm's powf), in which case nothing was written.
+bool DCIplanConvertSpan(const DCIplan &plan,
+						const float *in, float *out, size_t count,
+						size_t inStride, size_t outStride);
+
+
+// Same for planar data.  Packed output planes are converted where they are,
+// without going through a buffer.
+bool DCIplanConvertPlanar(const DCIplan &plan,
+							const float *const in[3], float *const out[3], size_t count,
+							size_t inStride, size_t outStride);
+
+
+// Runs a plan in place on packed planes of any length.  There's always a
+// way to: without a SIMD kernel it's the scalar one, whatever the precision.
+void DCIplanRun(const DCIplan &plan, float *r, float *g, float *b, size_t count);
+
+
+// Packed half to float and back, rounding to nearest even.  F16C when the
+// CPU has it, otherwise IlmBase's conversions.
+void DCIhalfToFloat(const half *in, float *out, size_t count);
+void DCIfloatToHalf(const float *in, half *out, size_t count);
+
+
+// one pixel at a time, any CPU
+void DCIkernel_Scalar(const DCIkernelParams &params, float *r, float *g, float *b, size_t count);
+void DCIstageKernel_Scalar(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count);
+
+
+#if DCI_SIMD_X86
+void DCIhalfToFloat_F16C(const half *in, float *out, size_t count);
+void DCIfloatToHalf_F16C(const float *in, half *out, size_t count);
+
+void DCIkernel_AVX2(const DCIkernelParams &params, float *r, float *g, float *b, size_t count);
+void DCIkernel_AVX512(const DCIkernelParams &params, float *r, float *g, float *b, size_t count);
+
+void DCIstageKernel_AVX2(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count);
+void DCIstageKernel_AVX512(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count);
+#endif
+
+
+#endif // INCLUDED_DCI_CONVERTER_SIMD_H
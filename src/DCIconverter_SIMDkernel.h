@@ -0,0 +1,626 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_SIMDkernel.h
+//
+// Conversion kernel written against a vector traits class V.
+// Included by each instruction set's .cpp after it defines its traits,
+// so the same code gets compiled once for AVX2 and once for AVX-512.
+//
+// V provides:
+//	F (float vector), I (int vector), M (comparison mask), Lanes
+//	set1, seti, loadu, storeu, add, sub, mul, div, fmadd, max, round
+//	le, lt, eq_i, select, and_i, or_i, add_i, sub_i, srl23, sll23
+//	asint, asfloat, itof, ftoi
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_SIMDKERNEL_H
+#define INCLUDED_DCI_CONVERTER_SIMDKERNEL_H
+
+
+#include "DCIconverter_SIMD.h"
+
+
+// With a copy of the kernel per precision, GCC runs out of inlining budget
+// and starts calling VecPow() and friends, which costs 5% or so.
+#if defined(_MSC_VER)
+	#define DCI_KERNEL_INLINE __forceinline
+#else
+	#define DCI_KERNEL_INLINE inline __attribute__((always_inline))
+#endif
+
+
+namespace {
+
+// Minimax polynomials for the approximate precisions, highest power first.
+// log2(1+t) = t * P(t) for t in [sqrt(0.5)-1, sqrt(2)-1], fitted for
+// absolute error, and 2^f for f in [-0.5, 0.5], fitted for relative error.
+// With exponents up to 2.6, pow()'s relative error is then under 6.5e-6
+// for Accurate16 and 1e-4 for Accurate12, a bit under half a code either way.
+
+constexpr float LOG2_POLY16[] = {	// error 2.1e-6
+	-2.065917700e-1f, 3.221548095e-1f, -3.674899745e-1f,
+	4.793480179e-1f, -7.211318585e-1f, 1.442713481e+0f
+};
+
+constexpr float LOG2_POLY12[] = {	// error 1.5e-5
+	2.526602482e-1f, -3.945753675e-1f, 4.866861550e-1f,
+	-7.202418029e-1f, 1.442578008e+0f
+};
+
+// Cephes library's exp2f(), used for Exact
+constexpr float EXP2_POLY[] = {
+	1.535336188319500e-4f, 1.339887440266574e-3f, 9.618437357674640e-3f,
+	5.550332471162809e-2f, 2.402264791363012e-1f, 6.931472028550421e-1f,
+	1.f
+};
+
+constexpr float EXP2_POLY16[] = {	// error 2.6e-6
+	9.570101630e-3f, 5.591786030e-2f, 2.402474483e-1f,
+	6.931218147e-1f, 9.999992614e-1f
+};
+
+constexpr float EXP2_POLY12[] = {	// error 7.5e-5
+	5.517166802e-2f, 2.426111221e-1f, 6.932609857e-1f,
+	9.999280735e-1f
+};
+
+
+// Horner's rule, the loop is unrolled since N is a constant
+template <class V, size_t N>
+static DCI_KERNEL_INLINE typename V::F
+VecPoly(const float (&c)[N], typename V::F x)
+{
+	typename V::F p = V::set1(c[0]);
+	
+	for(size_t i=1; i < N; i++)
+		p = V::fmadd(p, x, V::set1(c[i]));
+	
+	return p;
+}
+
+
+// log2() for positive, normal, finite x.
+// For Exact, the polynomial for log(1+t) is from the Cephes library's logf().
+template <class V, int PRECISION>
+static DCI_KERNEL_INLINE typename V::F
+VecLog2(typename V::F x)
+{
+	typedef typename V::F F;
+	typedef typename V::I I;
+	typedef typename V::M M;
+	
+	const I xi = V::asint(x);
+	
+	const I e = V::sub_i(V::srl23(xi), V::seti(127));
+	
+	F m = V::asfloat( V::or_i(V::and_i(xi, V::seti(0x007fffff)), V::seti(0x3f800000)) ); // [1, 2)
+	
+	// shift mantissa to [sqrt(0.5), sqrt(2)) so the polynomial is centered on 1
+	const M big = V::lt(V::set1(1.41421356f), m);
+	
+	m = V::select(big, V::mul(m, V::set1(0.5f)), m);
+	
+	const F ef = V::add(V::itof(e), V::select(big, V::set1(1.f), V::set1(0.f)));
+	
+	const F t = V::sub(m, V::set1(1.f));
+	
+	if(PRECISION == DCIconverterBase::Accurate16)
+		return V::fmadd(VecPoly<V>(LOG2_POLY16, t), t, ef);
+	else if(PRECISION == DCIconverterBase::Accurate12)
+		return V::fmadd(VecPoly<V>(LOG2_POLY12, t), t, ef);
+	
+	const F z = V::mul(t, t);
+	
+	F y = V::set1(7.0376836292E-2f);
+	y = V::fmadd(y, t, V::set1(-1.1514610310E-1f));
+	y = V::fmadd(y, t, V::set1(1.1676998740E-1f));
+	y = V::fmadd(y, t, V::set1(-1.2420140846E-1f));
+	y = V::fmadd(y, t, V::set1(1.4249322787E-1f));
+	y = V::fmadd(y, t, V::set1(-1.6668057665E-1f));
+	y = V::fmadd(y, t, V::set1(2.0000714765E-1f));
+	y = V::fmadd(y, t, V::set1(-2.4999993993E-1f));
+	y = V::fmadd(y, t, V::set1(3.3333331174E-1f));
+	y = V::mul(V::mul(y, t), z);
+	y = V::fmadd(z, V::set1(-0.5f), y);
+	
+	const F ln = V::add(t, y);
+	
+	return V::fmadd(ln, V::set1(1.44269504089f), ef);
+}
+
+
+// 2^x, flushing to zero below 2^-126.
+template <class V, int PRECISION>
+static DCI_KERNEL_INLINE typename V::F
+VecExp2(typename V::F x)
+{
+	typedef typename V::F F;
+	typedef typename V::M M;
+	
+	const M tiny = V::lt(x, V::set1(-126.f));
+	const M huge = V::le(V::set1(128.f), x);
+	
+	x = V::max(x, V::set1(-126.f));
+	x = V::select(huge, V::set1(127.f), x);
+	
+	const F n = V::round(x);
+	const F f = V::sub(x, n);
+	
+	F p = (PRECISION == DCIconverterBase::Accurate16 ? VecPoly<V>(EXP2_POLY16, f) :
+			PRECISION == DCIconverterBase::Accurate12 ? VecPoly<V>(EXP2_POLY12, f) :
+			VecPoly<V>(EXP2_POLY, f));
+	
+	// scale by 2^n by adding n to the exponent field
+	p = V::asfloat( V::add_i(V::asint(p), V::sll23(V::ftoi(n))) );
+	
+	p = V::select(tiny, V::set1(0.f), p);
+	
+	return V::select(huge, V::asfloat(V::seti(0x7f800000)), p);
+}
+
+
+// powf() for x >= 0 and y > 0.
+// Zero and denormals go to zero, inf and NaN pass through.
+template <class V, int PRECISION>
+static DCI_KERNEL_INLINE typename V::F
+VecPow(typename V::F x, typename V::F y)
+{
+	typedef typename V::F F;
+	typedef typename V::M M;
+	
+	const M zero = V::lt(x, V::set1(1.17549435e-38f));
+	const M special = V::eq_i(V::and_i(V::asint(x), V::seti(0x7f800000)), V::seti(0x7f800000));
+	
+	const F l = VecLog2<V, PRECISION>( V::max(x, V::set1(1.17549435e-38f)) );
+	
+	F r = VecExp2<V, PRECISION>( V::mul(y, l) );
+	
+	r = V::select(zero, V::set1(0.f), r);
+	
+	return V::select(special, x, r);
+}
+
+
+// GammaFunc() equivalent: the power is applied to the magnitude and the sign is kept
+template <class V, int PRECISION>
+static DCI_KERNEL_INLINE typename V::F
+VecGammaFunc(typename V::F x, typename V::F gamma)
+{
+	typedef typename V::F F;
+	typedef typename V::I I;
+	
+	const I sign = V::and_i(V::asint(x), V::seti(0x80000000));
+	
+	const F a = V::asfloat( V::and_i(V::asint(x), V::seti(0x7fffffff)) );
+	
+	return V::asfloat( V::or_i(V::asint(VecPow<V, PRECISION>(a, gamma)), sign) );
+}
+
+
+// Response curves.  Both sides of each piecewise function are computed
+// and the result is selected per lane.
+
+template <class V, int CURVE, int PRECISION>
+static DCI_KERNEL_INLINE typename V::F
+VecLinearize(typename V::F x, typename V::F gamma)
+{
+	typedef typename V::F F;
+	
+	if(CURVE == DCIconverterBase::sRGB)
+	{
+		const F lin = V::div(x, V::set1(12.92f));
+		const F pw = VecPow<V, PRECISION>(V::div(V::add(x, V::set1(0.055f)), V::set1(1.055f)), V::set1(2.4f));
+		
+		return V::select(V::le(x, V::set1(0.04045f)), lin, pw);
+	}
+	else if(CURVE == DCIconverterBase::Rec709)
+	{
+		const F lin = V::div(x, V::set1(4.5f));
+		const F pw = VecPow<V, PRECISION>(V::div(V::add(x, V::set1(0.099f)), V::set1(1.099f)), V::set1(1.0f / 0.45f));
+		
+		return V::select(V::le(x, V::set1(0.081f)), lin, pw);
+	}
+	else if(CURVE == DCIconverterBase::ProPhotoRGB)
+	{
+		const F lin = V::div(x, V::set1(16.f));
+		const F pw = VecPow<V, PRECISION>(x, V::set1(1.8f));
+		
+		return V::select(V::lt(x, V::set1(0.031248f)), lin, pw);
+	}
+	else if(CURVE == DCIconverterBase::P3 || CURVE == DCIconverterBase::Gamma)
+	{
+		return VecGammaFunc<V, PRECISION>(x, gamma);
+	}
+	else
+		return x;
+}
+
+
+template <class V, int CURVE, int PRECISION>
+static DCI_KERNEL_INLINE typename V::F
+VecDelinearize(typename V::F x, typename V::F gamma)
+{
+	typedef typename V::F F;
+	
+	if(CURVE == DCIconverterBase::sRGB)
+	{
+		const F lin = V::mul(x, V::set1(12.92f));
+		const F pw = V::fmadd(VecPow<V, PRECISION>(x, V::set1(1.f / 2.4f)), V::set1(1.055f), V::set1(-0.055f));
+		
+		return V::select(V::le(x, V::set1(0.0031308f)), lin, pw);
+	}
+	else if(CURVE == DCIconverterBase::Rec709)
+	{
+		const F lin = V::mul(x, V::set1(4.5f));
+		const F pw = V::fmadd(VecPow<V, PRECISION>(x, V::set1(0.45f)), V::set1(1.099f), V::set1(-0.099f));
+		
+		return V::select(V::le(x, V::set1(0.018f)), lin, pw);
+	}
+	else if(CURVE == DCIconverterBase::ProPhotoRGB)
+	{
+		const F lin = V::mul(x, V::set1(16.f));
+		const F pw = VecPow<V, PRECISION>(x, V::set1(1.f / 1.8f));
+		
+		return V::select(V::lt(x, V::set1(0.001953f)), lin, pw);
+	}
+	else if(CURVE == DCIconverterBase::P3 || CURVE == DCIconverterBase::Gamma)
+	{
+		return VecGammaFunc<V, PRECISION>(x, gamma);
+	}
+	else
+		return x;
+}
+
+
+template <class V>
+struct VecMatrix
+{
+	typename V::F m[3][3];
+	
+	VecMatrix(const float mat[3][3])
+	{
+		for(int i=0; i < 3; i++)
+			for(int j=0; j < 3; j++)
+				m[i][j] = V::set1(mat[i][j]);
+	}
+	
+	// out = in * m, with the pixel as a row vector like Imath
+	inline void
+	apply(typename V::F &a, typename V::F &b, typename V::F &c) const
+	{
+		const typename V::F x = V::fmadd(c, m[2][0], V::fmadd(b, m[1][0], V::mul(a, m[0][0])));
+		const typename V::F y = V::fmadd(c, m[2][1], V::fmadd(b, m[1][1], V::mul(a, m[0][1])));
+		const typename V::F z = V::fmadd(c, m[2][2], V::fmadd(b, m[1][2], V::mul(a, m[0][2])));
+		
+		a = x;
+		b = y;
+		c = z;
+	}
+};
+
+
+// The precision each stage actually runs at for a requested one.
+//
+// Forward, only the X'Y'Z' gamma gets the requested precision, nothing
+// after it can magnify its errors.  The input curve's errors go through
+// the matrix, and with primaries like ProPhoto's, whose red and green have
+// next to no Z, that leaves Z as the difference of two small products.
+// The X'Y'Z' gamma then magnifies close to black, where even Accurate16's
+// errors were worth a few codes, so the input curve is always exact.
+//
+// Reverse, the X'Y'Z' gamma is always exact.  The matrix takes differences
+// of X, Y and Z, and the output curve is steep near black, so saturated
+// colors would magnify errors there by a hundred times or more.  Only the
+// output curve gets the requested precision.
+template <int PRECISION, bool FORWARD>
+struct StagePrecision
+{
+	enum {
+		CURVE = (FORWARD ? DCIconverterBase::Exact : PRECISION),
+		XYZ_GAMMA = (FORWARD ? PRECISION : DCIconverterBase::Exact)
+	};
+};
+
+
+template <class V, int CURVE, int PRECISION, bool UNIT_XYZ>
+static void
+ForwardLoop(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	typedef typename V::F F;
+	typedef StagePrecision<PRECISION, true> P;
+	
+	const VecMatrix<V> matrix(params.matrix);
+	
+	const F gamma = V::set1(params.gamma);
+	const F xyz_gamma = V::set1(params.xyz_gamma);
+	
+	for(size_t i=0; i < count; i += V::Lanes)
+	{
+		F x = VecLinearize<V, CURVE, P::CURVE>(V::loadu(r + i), gamma);
+		F y = VecLinearize<V, CURVE, P::CURVE>(V::loadu(g + i), gamma);
+		F z = VecLinearize<V, CURVE, P::CURVE>(V::loadu(b + i), gamma);
+		
+		matrix.apply(x, y, z);
+		
+		if(!UNIT_XYZ)
+		{
+			x = VecGammaFunc<V, P::XYZ_GAMMA>(x, xyz_gamma);
+			y = VecGammaFunc<V, P::XYZ_GAMMA>(y, xyz_gamma);
+			z = VecGammaFunc<V, P::XYZ_GAMMA>(z, xyz_gamma);
+		}
+		
+		V::storeu(r + i, x);
+		V::storeu(g + i, y);
+		V::storeu(b + i, z);
+	}
+}
+
+
+template <class V, int CURVE, int PRECISION, bool UNIT_XYZ>
+static void
+ReverseLoop(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	typedef typename V::F F;
+	typedef StagePrecision<PRECISION, false> P;
+	
+	const VecMatrix<V> matrix(params.matrix);
+	
+	const F gamma = V::set1(params.gamma);
+	const F xyz_gamma = V::set1(params.xyz_gamma);
+	
+	for(size_t i=0; i < count; i += V::Lanes)
+	{
+		F x = V::loadu(r + i);
+		F y = V::loadu(g + i);
+		F z = V::loadu(b + i);
+		
+		if(!UNIT_XYZ)
+		{
+			x = VecGammaFunc<V, P::XYZ_GAMMA>(x, xyz_gamma);
+			y = VecGammaFunc<V, P::XYZ_GAMMA>(y, xyz_gamma);
+			z = VecGammaFunc<V, P::XYZ_GAMMA>(z, xyz_gamma);
+		}
+		
+		matrix.apply(x, y, z);
+		
+		V::storeu(r + i, VecDelinearize<V, CURVE, P::CURVE>(x, gamma));
+		V::storeu(g + i, VecDelinearize<V, CURVE, P::CURVE>(y, gamma));
+		V::storeu(b + i, VecDelinearize<V, CURVE, P::CURVE>(z, gamma));
+	}
+}
+
+
+template <class V, int CURVE, int PRECISION, bool FORWARD>
+static void
+VecLoop(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	// an X'Y'Z' gamma of 1.0 is a no-op, which is also how
+	// already-decoded input (say, from a lookup table) skips it
+	const bool unit_xyz = (params.xyz_gamma == 1.f);
+	
+	if(FORWARD)
+	{
+		if(unit_xyz)
+			ForwardLoop<V, CURVE, PRECISION, true>(params, r, g, b, count);
+		else
+			ForwardLoop<V, CURVE, PRECISION, false>(params, r, g, b, count);
+	}
+	else
+	{
+		if(unit_xyz)
+			ReverseLoop<V, CURVE, PRECISION, true>(params, r, g, b, count);
+		else
+			ReverseLoop<V, CURVE, PRECISION, false>(params, r, g, b, count);
+	}
+}
+
+
+template <class V, int PRECISION>
+static void
+VecCurveKernel(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	// pick the instantiation once per call, not once per pixel
+	#define DCI_KERNEL_CASE(CURVE) \
+		case DCIconverterBase::CURVE: \
+			if(params.forward) \
+				VecLoop<V, DCIconverterBase::CURVE, PRECISION, true>(params, r, g, b, count); \
+			else \
+				VecLoop<V, DCIconverterBase::CURVE, PRECISION, false>(params, r, g, b, count); \
+			break;
+	
+	switch(params.curve)
+	{
+		DCI_KERNEL_CASE(sRGB)
+		DCI_KERNEL_CASE(Rec709)
+		DCI_KERNEL_CASE(ProPhotoRGB)
+		DCI_KERNEL_CASE(P3)
+		DCI_KERNEL_CASE(Linear)
+		DCI_KERNEL_CASE(Gamma)
+	}
+	
+	#undef DCI_KERNEL_CASE
+}
+
+
+// One stage at a time, so instruments can time them separately.  Each loop
+// is its stage of ForwardLoop or ReverseLoop on its own, at the same
+// precision, so running a plan's stages one after another gives the same
+// pixels as the fused loop.
+
+template <class V, int CURVE, int PRECISION, bool FORWARD>
+static void
+CurveStageLoop(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	typedef typename V::F F;
+	typedef StagePrecision<PRECISION, FORWARD> P;
+	
+	const F gamma = V::set1(params.gamma);
+	
+	for(size_t i=0; i < count; i += V::Lanes)
+	{
+		if(FORWARD)
+		{
+			V::storeu(r + i, VecLinearize<V, CURVE, P::CURVE>(V::loadu(r + i), gamma));
+			V::storeu(g + i, VecLinearize<V, CURVE, P::CURVE>(V::loadu(g + i), gamma));
+			V::storeu(b + i, VecLinearize<V, CURVE, P::CURVE>(V::loadu(b + i), gamma));
+		}
+		else
+		{
+			V::storeu(r + i, VecDelinearize<V, CURVE, P::CURVE>(V::loadu(r + i), gamma));
+			V::storeu(g + i, VecDelinearize<V, CURVE, P::CURVE>(V::loadu(g + i), gamma));
+			V::storeu(b + i, VecDelinearize<V, CURVE, P::CURVE>(V::loadu(b + i), gamma));
+		}
+	}
+}
+
+
+template <class V>
+static void
+MatrixStageLoop(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	typedef typename V::F F;
+	
+	const VecMatrix<V> matrix(params.matrix);
+	
+	for(size_t i=0; i < count; i += V::Lanes)
+	{
+		F x = V::loadu(r + i);
+		F y = V::loadu(g + i);
+		F z = V::loadu(b + i);
+		
+		matrix.apply(x, y, z);
+		
+		V::storeu(r + i, x);
+		V::storeu(g + i, y);
+		V::storeu(b + i, z);
+	}
+}
+
+
+template <class V, int PRECISION>
+static void
+GammaStageLoop(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	typedef typename V::F F;
+	
+	const F xyz_gamma = V::set1(params.xyz_gamma);
+	
+	for(size_t i=0; i < count; i += V::Lanes)
+	{
+		V::storeu(r + i, VecGammaFunc<V, PRECISION>(V::loadu(r + i), xyz_gamma));
+		V::storeu(g + i, VecGammaFunc<V, PRECISION>(V::loadu(g + i), xyz_gamma));
+		V::storeu(b + i, VecGammaFunc<V, PRECISION>(V::loadu(b + i), xyz_gamma));
+	}
+}
+
+
+template <class V, int PRECISION>
+static void
+VecStage(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count)
+{
+	if(stage == DCI_STAGE_MATRIX)
+	{
+		MatrixStageLoop<V>(params, r, g, b, count);
+	}
+	else if(stage == DCI_STAGE_XYZ_GAMMA)
+	{
+		if(params.forward)
+			GammaStageLoop<V, StagePrecision<PRECISION, true>::XYZ_GAMMA>(params, r, g, b, count);
+		else
+			GammaStageLoop<V, StagePrecision<PRECISION, false>::XYZ_GAMMA>(params, r, g, b, count);
+	}
+	else
+	{
+		#define DCI_STAGE_CASE(CURVE) \
+			case DCIconverterBase::CURVE: \
+				if(params.forward) \
+					CurveStageLoop<V, DCIconverterBase::CURVE, PRECISION, true>(params, r, g, b, count); \
+				else \
+					CurveStageLoop<V, DCIconverterBase::CURVE, PRECISION, false>(params, r, g, b, count); \
+				break;
+		
+		switch(params.curve)
+		{
+			DCI_STAGE_CASE(sRGB)
+			DCI_STAGE_CASE(Rec709)
+			DCI_STAGE_CASE(ProPhotoRGB)
+			DCI_STAGE_CASE(P3)
+			DCI_STAGE_CASE(Linear)
+			DCI_STAGE_CASE(Gamma)
+		}
+		
+		#undef DCI_STAGE_CASE
+	}
+}
+
+
+template <class V>
+static void
+VecStageKernel(const DCIkernelParams &params, DCIplanStage stage, float *r, float *g, float *b, size_t count)
+{
+	switch(params.precision)
+	{
+		case DCIconverterBase::Accurate16:
+			VecStage<V, DCIconverterBase::Accurate16>(params, stage, r, g, b, count);
+			break;
+		case DCIconverterBase::Accurate12:
+			VecStage<V, DCIconverterBase::Accurate12>(params, stage, r, g, b, count);
+			break;
+		default:
+			VecStage<V, DCIconverterBase::Exact>(params, stage, r, g, b, count);
+	}
+}
+
+
+template <class V>
+static void
+VecKernel(const DCIkernelParams &params, float *r, float *g, float *b, size_t count)
+{
+	switch(params.precision)
+	{
+		case DCIconverterBase::Accurate16:
+			VecCurveKernel<V, DCIconverterBase::Accurate16>(params, r, g, b, count);
+			break;
+		case DCIconverterBase::Accurate12:
+			VecCurveKernel<V, DCIconverterBase::Accurate12>(params, r, g, b, count);
+			break;
+		default:
+			VecCurveKernel<V, DCIconverterBase::Exact>(params, r, g, b, count);
+	}
+}
+
+} // namespace
+
+
+#endif // INCLUDED_DCI_CONVERTER_SIMDKERNEL_H
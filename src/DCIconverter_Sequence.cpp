@@ -0,0 +1,440 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Sequence.cpp
+//
+// Read, convert and write a sequence of frames at the same time
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Sequence.h"
+
+#include "DCIconverter_Trace.h"
+
+#include <chrono>
+#include <thread>
+
+
+typedef std::chrono::steady_clock Clock;
+
+static inline double
+Seconds(const Clock::time_point &start)
+{
+	return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+
+// Spin a little, then sleep.  The queues don't block, so this is how a
+// stage waits for another one.
+class Backoff
+{
+  public:
+	Backoff() : _spins(0) {}
+	
+	void wait()
+	{
+		if(_spins < 64)
+		{
+			_spins++;
+			std::this_thread::yield();
+		}
+		else
+			std::this_thread::sleep_for( std::chrono::microseconds(100) );
+	}
+	
+	void reset() { _spins = 0; }
+	
+  private:
+	int _spins;
+};
+
+
+double
+SequenceStageStats::utilization(double elapsed) const
+{
+	return (elapsed > 0.0 && threads > 0 ? busy / (elapsed * threads) : 0.0);
+}
+
+
+static void
+AddStats(SequenceStageStats &total, const SequenceStageStats &thread)
+{
+	total.frames += thread.frames;
+	total.busy += thread.busy;
+	total.starved += thread.starved;
+	total.blocked += thread.blocked;
+}
+
+
+static SequenceStageStats
+EmptyStats(int threads)
+{
+	const SequenceStageStats stats = { threads, 0, 0.0, 0.0, 0.0 };
+	
+	return stats;
+}
+
+
+SequenceProcessor::SequenceProcessor(int readers, int writers, int frames) :
+	_readers(readers > 0 ? readers : 1),
+	_writers(writers > 0 ? writers : 1),
+	_frames(frames > 0 ? frames : _readers + _writers + 2)
+{
+
+}
+
+
+namespace {
+
+typedef struct Shared {
+	Shared(size_t frames) : free(frames), converting(frames), writing(frames),
+							next(0), readers_left(0), converted(false), abort(false) {}
+	
+	BoundedQueue<SequenceFrame *> free;
+	BoundedQueue<SequenceFrame *> converting;
+	BoundedQueue<SequenceFrame *> writing;
+	
+	std::atomic<size_t> next; // next frame number to read
+	std::atomic<int> readers_left;
+	std::atomic<bool> converted; // convert stage has finished
+	std::atomic<bool> abort;
+	
+	std::mutex mutex;
+	std::exception_ptr error;
+	SequenceStats stats;
+	
+	void fail()
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		
+		if(!error)
+			error = std::current_exception();
+		
+		abort = true;
+	}
+	
+	void addStats(SequenceStageStats SequenceStats::*stage, const SequenceStageStats &thread)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		
+		AddStats(stats.*stage, thread);
+	}
+} Shared;
+
+
+// Wait for a frame to pop.  Gives up when done() says nothing more is
+// coming, after one last look, or when another stage has failed.
+template <typename DONE>
+static bool
+PopFrame(Shared &shared, BoundedQueue<SequenceFrame *> &queue, SequenceFrame *&frame, double &waited, DONE done)
+{
+	const Clock::time_point start = Clock::now();
+	
+	Backoff backoff;
+	
+	bool got = false;
+	bool waiting = false;
+	
+	while( !(got = queue.pop(frame)) )
+	{
+		waiting = true;
+		
+		if(shared.abort)
+			break;
+		
+		if( done() )
+		{
+			got = queue.pop(frame);
+			break;
+		}
+		
+		backoff.wait();
+	}
+	
+	waited += Seconds(start);
+	
+	if(waiting)
+		ConverterTrace::Record("wait for frame", "queue", start, Clock::now());
+	
+	return got;
+}
+
+
+static bool
+PushFrame(Shared &shared, BoundedQueue<SequenceFrame *> &queue, SequenceFrame *frame, double &waited)
+{
+	const Clock::time_point start = Clock::now();
+	
+	Backoff backoff;
+	
+	bool pushed = false;
+	bool waiting = false;
+	
+	while( !(pushed = queue.push(frame)) && !shared.abort )
+	{
+		waiting = true;
+		
+		backoff.wait();
+	}
+	
+	waited += Seconds(start);
+	
+	if(waiting)
+		ConverterTrace::Record("wait for room", "queue", start, Clock::now(), frame->number);
+	
+	return pushed;
+}
+
+
+static void
+ReadLoop(Shared &shared, size_t count, const SequenceProcessor::Stage &read, int index)
+{
+	ConverterTrace::SetThreadName("reader", index);
+	
+	SequenceStageStats stats = EmptyStats(0);
+	
+	try
+	{
+		for(;;)
+		{
+			const size_t number = shared.next++;
+			
+			if(number >= count || shared.abort)
+				break;
+			
+			// waiting for a free frame is waiting on the stages downstream
+			SequenceFrame *frame = NULL;
+			
+			if( !PopFrame(shared, shared.free, frame, stats.blocked, [] { return false; }) )
+				break;
+			
+			frame->number = number;
+			
+			const Clock::time_point start = Clock::now();
+			
+			read(*frame);
+			
+			stats.busy += Seconds(start);
+			
+			ConverterTrace::Record("read", "sequence", start, Clock::now(), number);
+			stats.frames++;
+			
+			if( !PushFrame(shared, shared.converting, frame, stats.blocked) )
+				break;
+		}
+	}
+	catch(...)
+	{
+		shared.fail();
+	}
+	
+	shared.addStats(&SequenceStats::read, stats);
+	
+	shared.readers_left--;
+}
+
+
+static void
+WriteLoop(Shared &shared, const SequenceProcessor::Stage &write, int index)
+{
+	ConverterTrace::SetThreadName("writer", index);
+	
+	SequenceStageStats stats = EmptyStats(0);
+	
+	try
+	{
+		for(;;)
+		{
+			SequenceFrame *frame = NULL;
+			
+			if( !PopFrame(shared, shared.writing, frame, stats.starved, [&shared] { return (bool)shared.converted; }) )
+				break;
+			
+			const Clock::time_point start = Clock::now();
+			
+			write(*frame);
+			
+			stats.busy += Seconds(start);
+			
+			ConverterTrace::Record("write", "sequence", start, Clock::now(), frame->number);
+			stats.frames++;
+			
+			// there's always room, the queue holds every frame
+			shared.free.push(frame);
+		}
+	}
+	catch(...)
+	{
+		shared.fail();
+	}
+	
+	shared.addStats(&SequenceStats::write, stats);
+}
+
+} // namespace
+
+
+SequenceStats
+SequenceProcessor::run(size_t count, const Stage &read, const Stage &convert, const Stage &write,
+						const FrameFactory &factory) const
+{
+	const size_t num_frames = (count < (size_t)_frames ? (count > 0 ? count : 1) : (size_t)_frames);
+	const int num_readers = (count < (size_t)_readers ? (int)num_frames : _readers);
+	const int num_writers = (count < (size_t)_writers ? (int)num_frames : _writers);
+	
+	Shared shared(num_frames);
+	
+	shared.stats.elapsed = 0.0;
+	shared.stats.read = EmptyStats(num_readers);
+	shared.stats.convert = EmptyStats(1);
+	shared.stats.write = EmptyStats(num_writers);
+	
+	std::vector< std::unique_ptr<SequenceFrame> > frames;
+	
+	for(size_t i=0; i < num_frames; i++)
+	{
+		frames.push_back( std::unique_ptr<SequenceFrame>(factory ? factory() : new SequenceFrame) );
+		
+		shared.free.push( frames.back().get() );
+	}
+	
+	
+	const Clock::time_point start = Clock::now();
+	
+	shared.readers_left = num_readers;
+	
+	std::vector<std::thread> threads;
+	
+	for(int i=0; i < num_readers; i++)
+		threads.push_back( std::thread(ReadLoop, std::ref(shared), count, std::cref(read), i) );
+	
+	for(int i=0; i < num_writers; i++)
+		threads.push_back( std::thread(WriteLoop, std::ref(shared), std::cref(write), i) );
+	
+	
+	// the convert stage is this thread
+	ConverterTrace::SetThreadName("convert");
+	
+	SequenceStageStats stats = EmptyStats(0);
+	
+	try
+	{
+		for(;;)
+		{
+			SequenceFrame *frame = NULL;
+			
+			if( !PopFrame(shared, shared.converting, frame, stats.starved, [&shared] { return (shared.readers_left == 0); }) )
+				break;
+			
+			const Clock::time_point convert_start = Clock::now();
+			
+			convert(*frame);
+			
+			stats.busy += Seconds(convert_start);
+			
+			ConverterTrace::Record("convert", "sequence", convert_start, Clock::now(), frame->number);
+			stats.frames++;
+			
+			if( !PushFrame(shared, shared.writing, frame, stats.blocked) )
+				break;
+		}
+	}
+	catch(...)
+	{
+		shared.fail();
+	}
+	
+	shared.converted = true;
+	
+	for(size_t i=0; i < threads.size(); i++)
+		threads[i].join();
+	
+	shared.addStats(&SequenceStats::convert, stats);
+	
+	shared.stats.elapsed = Seconds(start);
+	
+	
+	if(shared.error)
+		std::rethrow_exception(shared.error);
+	
+	return shared.stats;
+}
+
+
+SequenceProcessor::Stage
+SequenceProcessor::ConvertStage(const ImageConverter &imageConverter, const DCIconverterBase &converter)
+{
+	return [&imageConverter, &converter](SequenceFrame &frame) {
+		imageConverter.convert(converter, frame.image);
+	};
+}
+
+
+void
+SequenceProcessor::PrintStats(FILE *file, const SequenceStats &stats)
+{
+	const struct {
+		const char *name;
+		const SequenceStageStats *stage;
+	} stages[] = {
+		{ "read", &stats.read },
+		{ "convert", &stats.convert },
+		{ "write", &stats.write }
+	};
+	
+	const char *bottleneck = NULL;
+	double most = 0.0;
+	
+	for(int i=0; i < 3; i++)
+	{
+		const SequenceStageStats &stage = *stages[i].stage;
+		
+		const double utilization = stage.utilization(stats.elapsed);
+		
+		fprintf(file, "%-8s %2d thread%s %6lu frames %6.1f%% busy %9.2fs starved %9.2fs blocked\n",
+					stages[i].name, stage.threads, (stage.threads == 1 ? " " : "s"), (unsigned long)stage.frames,
+					utilization * 100.0, stage.starved, stage.blocked);
+		
+		if(utilization > most)
+		{
+			most = utilization;
+			bottleneck = stages[i].name;
+		}
+	}
+	
+	if(bottleneck != NULL)
+	{
+		fprintf(file, "%.2fs, %.2f frames/s, %s is the busiest stage\n",
+					stats.elapsed, (stats.elapsed > 0.0 ? stats.convert.frames / stats.elapsed : 0.0), bottleneck);
+	}
+}
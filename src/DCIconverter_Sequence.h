@@ -0,0 +1,252 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Sequence.h
+//
+// Read, convert and write a sequence of frames at the same time
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_SEQUENCE_H
+#define INCLUDED_DCI_CONVERTER_SEQUENCE_H
+
+
+#include "DCIconverter_Image.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+// Fixed-size multi-producer, multi-consumer queue without locks.  Every
+// cell carries a sequence number that says whether it's ready to be
+// written or read on the current lap around the ring (Dmitry Vyukov's
+// bounded MPMC queue).  push() and pop() return false instead of waiting
+// when the queue is full or empty.
+
+template <typename T>
+class BoundedQueue
+{
+  public:
+	// capacity is rounded up to a power of two
+	BoundedQueue(size_t capacity);
+	
+	bool push(const T &value);
+	bool pop(T &value);
+	
+	size_t capacity() const { return _mask + 1; }
+	
+  private:
+	typedef struct Cell {
+		std::atomic<size_t> sequence;
+		T value;
+	} Cell;
+	
+	std::unique_ptr<Cell[]> _cells;
+	size_t _mask;
+	
+	// on separate cache lines so producers and consumers don't fight over them
+	alignas(64) std::atomic<size_t> _head;
+	alignas(64) std::atomic<size_t> _tail;
+	
+	BoundedQueue(const BoundedQueue &);
+	BoundedQueue &operator=(const BoundedQueue &);
+};
+
+
+template <typename T>
+BoundedQueue<T>::BoundedQueue(size_t capacity) :
+	_head(0),
+	_tail(0)
+{
+	size_t size = 2;
+	
+	while(size < capacity)
+		size *= 2;
+	
+	_cells.reset(new Cell[size]);
+	_mask = size - 1;
+	
+	for(size_t i=0; i < size; i++)
+		_cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+
+template <typename T>
+bool
+BoundedQueue<T>::push(const T &value)
+{
+	size_t pos = _tail.load(std::memory_order_relaxed);
+	
+	for(;;)
+	{
+		Cell &cell = _cells[pos & _mask];
+		
+		const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		
+		const ptrdiff_t lap = (ptrdiff_t)sequence - (ptrdiff_t)pos;
+		
+		if(lap == 0)
+		{
+			// cell is free on this lap, claim it
+			if( _tail.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) )
+			{
+				cell.value = value;
+				cell.sequence.store(pos + 1, std::memory_order_release);
+				
+				return true;
+			}
+		}
+		else if(lap < 0)
+		{
+			return false; // full
+		}
+		else
+			pos = _tail.load(std::memory_order_relaxed);
+	}
+}
+
+
+template <typename T>
+bool
+BoundedQueue<T>::pop(T &value)
+{
+	size_t pos = _head.load(std::memory_order_relaxed);
+	
+	for(;;)
+	{
+		Cell &cell = _cells[pos & _mask];
+		
+		const size_t sequence = cell.sequence.load(std::memory_order_acquire);
+		
+		const ptrdiff_t lap = (ptrdiff_t)sequence - (ptrdiff_t)(pos + 1);
+		
+		if(lap == 0)
+		{
+			if( _head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed) )
+			{
+				value = cell.value;
+				cell.sequence.store(pos + _mask + 1, std::memory_order_release);
+				
+				return true;
+			}
+		}
+		else if(lap < 0)
+		{
+			return false; // empty
+		}
+		else
+			pos = _head.load(std::memory_order_relaxed);
+	}
+}
+
+
+// One frame's worth of buffers.  Frames are made once, passed from stage
+// to stage and then reused for a later frame, so a long sequence doesn't
+// allocate anything per frame.  Subclass it to carry whatever the read and
+// write stages need (file headers, paths, encoded output).
+class SequenceFrame
+{
+  public:
+	SequenceFrame() : number(0), image(NULL, 0, 0, 0) {}
+	virtual ~SequenceFrame() {}
+	
+	size_t number; // 0 to count-1, set before the read stage is called
+	
+	// what the convert stage converts in place, set by the read stage
+	ImageView image;
+};
+
+
+// Time a stage's threads spent working, waiting for a frame to work on,
+// and waiting to hand a frame on (or for a free frame to read into).
+typedef struct SequenceStageStats {
+	int threads;
+	size_t frames;
+	double busy;
+	double starved;
+	double blocked;
+	
+	// share of the stage's thread time spent working
+	double utilization(double elapsed) const;
+} SequenceStageStats;
+
+typedef struct SequenceStats {
+	double elapsed;
+	SequenceStageStats read;
+	SequenceStageStats convert;
+	SequenceStageStats write;
+} SequenceStats;
+
+
+// Three stages joined by BoundedQueues: reader threads fill frames, the
+// calling thread converts them one at a time (each frame spread over a
+// ThreadPool), and writer threads save them and hand the frame back to be
+// read into again.  The number of frames in flight is fixed, so when one
+// stage falls behind the others wait for it instead of piling up frames.
+//
+// Frames are read, converted and written in no particular order.  If any
+// stage throws, the others stop at their next frame and run() rethrows
+// the first exception.
+
+class SequenceProcessor
+{
+  public:
+	typedef std::function<void (SequenceFrame &)> Stage;
+	typedef std::function<SequenceFrame * ()> FrameFactory;
+	
+	// frames in flight defaults to one for every reader and writer plus two
+	SequenceProcessor(int readers = 2, int writers = 2, int frames = 0);
+	
+	// factory makes the frames (deleted when run() is done), NULL for plain SequenceFrames
+	SequenceStats run(size_t count, const Stage &read, const Stage &convert, const Stage &write,
+						const FrameFactory &factory = FrameFactory()) const;
+	
+	// a convert stage that runs frame.image through converter in place
+	static Stage ConvertStage(const ImageConverter &imageConverter, const DCIconverterBase &converter);
+	
+	// one line per stage with utilization and where the time went
+	static void PrintStats(FILE *file, const SequenceStats &stats);
+	
+  private:
+	const int _readers;
+	const int _writers;
+	const int _frames;
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_SEQUENCE_H
@@ -0,0 +1,384 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Stats.cpp
+//
+// Counters and timers for what the converters have been doing
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Stats.h"
+
+#include "IexBaseExc.h"
+
+#include <mutex>
+#include <vector>
+
+#ifdef _WIN32
+	#include <windows.h>
+#endif
+
+
+std::atomic<bool> ConverterInstruments::_enabled(false);
+
+
+namespace {
+
+// One per thread, in its thread-local storage.  Only the owning thread
+// writes to it, so adding is a plain load and store, no locked
+// instructions.  Collect() reads them from other threads.
+struct alignas(64) Shard
+{
+	std::atomic<unsigned long long> pixels;
+	std::atomic<unsigned long long> negative;
+	std::atomic<unsigned long long> clipped;
+	std::atomic<unsigned long long> calls[STATS_STAGES];
+	std::atomic<unsigned long long> nanoseconds[STATS_STAGES];
+	
+	Shard();
+	~Shard();
+	
+	void addTo(ConverterStats &stats) const;
+};
+
+
+static std::mutex g_shards_mutex;
+static std::vector<const Shard *> g_shards;
+static ConverterStats g_retired = ConverterStats(); // from threads that have exited
+static ConverterStats g_baseline = ConverterStats();
+
+static thread_local Shard t_shard;
+
+
+Shard::Shard() : pixels(0), negative(0), clipped(0)
+{
+	for(int s=0; s < STATS_STAGES; s++)
+	{
+		calls[s].store(0);
+		nanoseconds[s].store(0);
+	}
+	
+	std::lock_guard<std::mutex> lock(g_shards_mutex);
+	
+	g_shards.push_back(this);
+}
+
+
+Shard::~Shard()
+{
+	// nothing counted is lost when a thread pool shrinks
+	std::lock_guard<std::mutex> lock(g_shards_mutex);
+	
+	addTo(g_retired);
+	
+	for(size_t i=0; i < g_shards.size(); i++)
+	{
+		if(g_shards[i] == this)
+		{
+			g_shards.erase(g_shards.begin() + i);
+			break;
+		}
+	}
+}
+
+
+void
+Shard::addTo(ConverterStats &stats) const
+{
+	stats.pixels += pixels.load(std::memory_order_relaxed);
+	stats.negative += negative.load(std::memory_order_relaxed);
+	stats.clipped += clipped.load(std::memory_order_relaxed);
+	
+	for(int s=0; s < STATS_STAGES; s++)
+	{
+		stats.calls[s] += calls[s].load(std::memory_order_relaxed);
+		stats.seconds[s] += nanoseconds[s].load(std::memory_order_relaxed) * 1e-9;
+	}
+}
+
+
+static inline void
+Add(std::atomic<unsigned long long> &counter, unsigned long long n)
+{
+	counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+
+// call with the mutex held
+static ConverterStats
+Total()
+{
+	ConverterStats total = g_retired;
+	
+	for(size_t i=0; i < g_shards.size(); i++)
+		g_shards[i]->addTo(total);
+	
+	return total;
+}
+
+
+// Channels under 0 and over 1 in a run of floats.  The scan has to cost
+// little next to the conversion that just wrote them, so it keeps four
+// counts of each, which compilers turn into vector compares even at -O2.
+static void
+CountRange(const float *values, size_t count, unsigned long long &negative, unsigned long long &over)
+{
+	unsigned int under_zero[4] = { 0, 0, 0, 0 };
+	unsigned int over_one[4] = { 0, 0, 0, 0 };
+	
+	size_t i = 0;
+	
+	for(; i + 4 <= count; i += 4)
+	{
+		for(int j=0; j < 4; j++)
+		{
+			under_zero[j] += (values[i + j] < 0.f);
+			over_one[j] += (values[i + j] > 1.f);
+		}
+	}
+	
+	for(; i < count; i++)
+	{
+		under_zero[0] += (values[i] < 0.f);
+		over_one[0] += (values[i] > 1.f);
+	}
+	
+	negative += (unsigned long long)under_zero[0] + under_zero[1] + under_zero[2] + under_zero[3];
+	over += (unsigned long long)over_one[0] + over_one[1] + over_one[2] + over_one[3];
+}
+
+
+static void
+AddCounts(size_t pixels, unsigned long long under, unsigned long long over)
+{
+	Add(t_shard.pixels, pixels);
+	Add(t_shard.clipped, under + over);
+}
+
+} // namespace
+
+
+ConverterStats
+ConverterInstruments::Collect()
+{
+	std::lock_guard<std::mutex> lock(g_shards_mutex);
+	
+	ConverterStats stats = Total();
+	
+	stats.pixels -= g_baseline.pixels;
+	stats.negative -= g_baseline.negative;
+	stats.clipped -= g_baseline.clipped;
+	
+	for(int s=0; s < STATS_STAGES; s++)
+	{
+		stats.calls[s] -= g_baseline.calls[s];
+		stats.seconds[s] -= g_baseline.seconds[s];
+	}
+	
+	return stats;
+}
+
+
+void
+ConverterInstruments::Reset()
+{
+	// The shards belong to their threads, so rather than zero them under
+	// their feet, later Collect()s subtract what they say now.
+	std::lock_guard<std::mutex> lock(g_shards_mutex);
+	
+	g_baseline = Total();
+}
+
+
+const char *
+ConverterInstruments::StageName(StatsStage stage)
+{
+	switch(stage)
+	{
+		case STATS_DECODE:	return "decode";
+		case STATS_MATRIX:	return "matrix";
+		case STATS_ENCODE:	return "encode";
+		case STATS_FIXED:	return "fixed";
+		default:			return "unknown";
+	}
+}
+
+
+void
+ConverterInstruments::WritePrometheus(FILE *file, const ConverterStats &stats)
+{
+	fprintf(file,
+		"# HELP dci_pixels_total Pixels converted.\n"
+		"# TYPE dci_pixels_total counter\n"
+		"dci_pixels_total %llu\n"
+		"# HELP dci_negative_channels_total Channels that went into a power under 0, through its sign path.\n"
+		"# TYPE dci_negative_channels_total counter\n"
+		"dci_negative_channels_total %llu\n"
+		"# HELP dci_clipped_channels_total Float output channels outside 0-1, clamped by 12-bit DCDM encoding.\n"
+		"# TYPE dci_clipped_channels_total counter\n"
+		"dci_clipped_channels_total %llu\n",
+		stats.pixels, stats.negative, stats.clipped);
+	
+	fprintf(file,
+		"# HELP dci_stage_seconds_total Conversion time by stage, summed over threads.\n"
+		"# TYPE dci_stage_seconds_total counter\n");
+	
+	for(int s=0; s < STATS_STAGES; s++)
+		fprintf(file, "dci_stage_seconds_total{stage=\"%s\"} %.9f\n", StageName((StatsStage)s), stats.seconds[s]);
+	
+	fprintf(file,
+		"# HELP dci_stage_calls_total Spans converted by stage.\n"
+		"# TYPE dci_stage_calls_total counter\n");
+	
+	for(int s=0; s < STATS_STAGES; s++)
+		fprintf(file, "dci_stage_calls_total{stage=\"%s\"} %llu\n", StageName((StatsStage)s), stats.calls[s]);
+}
+
+
+void
+ConverterInstruments::WritePrometheus(const std::string &path, const ConverterStats &stats)
+{
+	const std::string temp_path = path + ".tmp";
+	
+	FILE *file = fopen(temp_path.c_str(), "w");
+	
+	if(file == NULL)
+		throw Iex::IoExc("Unable to open " + temp_path);
+	
+	WritePrometheus(file, stats);
+	
+	const bool written = (ferror(file) == 0);
+	
+	if(fclose(file) != 0 || !written)
+	{
+		remove(temp_path.c_str());
+		throw Iex::IoExc("Unable to write " + temp_path);
+	}
+	
+#ifdef _WIN32
+	const bool renamed = (MoveFileExA(temp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING) != 0);
+#else
+	const bool renamed = (rename(temp_path.c_str(), path.c_str()) == 0);
+#endif
+	
+	if(!renamed)
+	{
+		remove(temp_path.c_str());
+		throw Iex::IoExc("Unable to write " + path);
+	}
+}
+
+
+void
+ConverterInstruments::CountOutput(const float *out, size_t count, size_t stride)
+{
+	if( !Enabled() )
+		return;
+	
+	unsigned long long under = 0;
+	unsigned long long over = 0;
+	
+	if(stride == 3)
+	{
+		CountRange(out, count * 3, under, over);
+	}
+	else
+	{
+		for(size_t i=0; i < count; i++)
+		{
+			CountRange(out, 3, under, over);
+			
+			out += stride;
+		}
+	}
+	
+	AddCounts(count, under, over);
+}
+
+
+void
+ConverterInstruments::CountOutput(const float *const out[3], size_t count, size_t stride)
+{
+	if( !Enabled() )
+		return;
+	
+	unsigned long long under = 0;
+	unsigned long long over = 0;
+	
+	for(int c=0; c < 3; c++)
+	{
+		if(stride == 1)
+		{
+			CountRange(out[c], count, under, over);
+		}
+		else
+		{
+			for(size_t i=0; i < count; i++)
+				CountRange(&out[c][i * stride], 1, under, over);
+		}
+	}
+	
+	AddCounts(count, under, over);
+}
+
+
+void
+ConverterInstruments::CountPixels(size_t count)
+{
+	if( Enabled() )
+		Add(t_shard.pixels, count);
+}
+
+
+void
+ConverterInstruments::CountSignPath(const float *const planes[3], size_t count)
+{
+	if( !Enabled() )
+		return;
+	
+	unsigned long long negative = 0;
+	unsigned long long over = 0;
+	
+	for(int c=0; c < 3; c++)
+		CountRange(planes[c], count, negative, over);
+	
+	Add(t_shard.negative, negative);
+}
+
+
+void
+ConverterInstruments::AddTime(StatsStage stage, std::chrono::steady_clock::duration elapsed)
+{
+	Add(t_shard.calls[stage], 1);
+	Add(t_shard.nanoseconds[stage], std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+}
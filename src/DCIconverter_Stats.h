@@ -0,0 +1,183 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Stats.h
+//
+// Counters and timers for what the converters have been doing
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_STATS_H
+#define INCLUDED_DCI_CONVERTER_STATS_H
+
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+
+// Where conversion time goes.  Decode is the input curve going forward and
+// the X'Y'Z' gamma in reverse, encode the other one.  The SIMD kernels do
+// all three stages in one pass, so while instruments are on they run a
+// stage at a time instead, which gives the same pixels a little slower.
+// Normalization is always folded into the matrix.
+typedef enum {
+	STATS_DECODE,	// input side: the first curve, code value and half tables
+	STATS_MATRIX,	// the matrix
+	STATS_ENCODE,	// output side: the last curve, half and DCDM encode tables
+	STATS_FIXED,	// the all-integer pipeline, start to finish
+	STATS_STAGES
+} StatsStage;
+
+
+typedef struct ConverterStats {
+	unsigned long long pixels;		// float and integer pixels converted
+	unsigned long long negative;	// channels that went into a power under 0, and so through its sign path
+	unsigned long long clipped;		// float output channels outside 0-1, which 12-bit DCDM encoding clamps
+	unsigned long long calls[STATS_STAGES];
+	double seconds[STATS_STAGES];	// summed over threads
+} ConverterStats;
+
+
+// Instrumentation for the Forward and Reverse converters and the loops
+// that drive them.  Off until SetEnabled(true), and then cheap enough to
+// leave on: each thread counts into its own cache line, timers are read
+// once per block rather than per pixel, and values are only scanned for
+// negative and clipped ones while they're still in cache.
+//
+// Integer paths count pixels and time, not negative or clipped values.
+// Neither do table lookups, whose powers were taken when the table was built.
+
+class ConverterInstruments
+{
+  public:
+	static void SetEnabled(bool enabled) { _enabled.store(enabled, std::memory_order_relaxed); }
+	static bool Enabled() { return _enabled.load(std::memory_order_relaxed); }
+	
+	// every thread's counters added up, since the last Reset()
+	static ConverterStats Collect();
+	static void Reset();
+	
+	static const char *StageName(StatsStage stage);
+	
+	// Prometheus text exposition format.  The file version writes to a
+	// temporary file and renames it into place, so a node_exporter textfile
+	// collector never reads half a file.
+	static void WritePrometheus(FILE *file, const ConverterStats &stats);
+	static void WritePrometheus(const std::string &path, const ConverterStats &stats);
+	
+	// For the converters.  Pixels written to out, counted along with the
+	// negative and clipped channels in them.  Strides are in floats.
+	static void CountOutput(const float *out, size_t count, size_t stride);
+	static void CountOutput(const float *const out[3], size_t count, size_t stride);
+	static void CountPixels(size_t count);
+	
+	// Packed planes about to go into a power, counted if they're negative.
+	static void CountSignPath(const float *const planes[3], size_t count);
+	
+	// Times the scope it's declared in.
+	class Timer
+	{
+	  public:
+		Timer(StatsStage stage) : _stage(stage), _running( Enabled() )
+		{
+			if(_running)
+				_start = std::chrono::steady_clock::now();
+		}
+		
+		~Timer()
+		{
+			if(_running)
+				AddTime(_stage, std::chrono::steady_clock::now() - _start);
+		}
+		
+	  private:
+		const StatsStage _stage;
+		const bool _running;
+		std::chrono::steady_clock::time_point _start;
+	};
+	
+	// Times stages that take turns in the scope it's declared in, a block
+	// at a time.  Each lap() books the time since the last one (or since
+	// the timer was declared) to a stage, and each stage that had any is
+	// added once, as one call, when the scope ends.
+	class StageTimer
+	{
+	  public:
+		StageTimer() : _running( Enabled() )
+		{
+			for(int s=0; s < STATS_STAGES; s++)
+				_elapsed[s] = std::chrono::steady_clock::duration::zero();
+			
+			if(_running)
+				_last = std::chrono::steady_clock::now();
+		}
+		
+		~StageTimer()
+		{
+			for(int s=0; s < STATS_STAGES; s++)
+			{
+				if(_elapsed[s] != std::chrono::steady_clock::duration::zero())
+					AddTime((StatsStage)s, _elapsed[s]);
+			}
+		}
+		
+		bool running() const { return _running; }
+		
+		void lap(StatsStage stage)
+		{
+			if(_running)
+			{
+				const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+				
+				_elapsed[stage] += now - _last;
+				_last = now;
+			}
+		}
+		
+	  private:
+		const bool _running;
+		std::chrono::steady_clock::time_point _last;
+		std::chrono::steady_clock::duration _elapsed[STATS_STAGES];
+	};
+	
+  private:
+	static std::atomic<bool> _enabled;
+	
+	static void AddTime(StatsStage stage, std::chrono::steady_clock::duration elapsed);
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_STATS_H
@@ -0,0 +1,259 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_ThreadPool.cpp
+//
+// Persistent work-stealing thread pool
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_ThreadPool.h"
+
+#include "DCIconverter_Trace.h"
+
+
+ThreadPool::ThreadPool(int threads) :
+	_queued(0),
+	_next_queue(0),
+	_quit(false)
+{
+	if(threads < 0)
+	{
+		const int hardware = std::thread::hardware_concurrency();
+		
+		threads = (hardware > 1 ? hardware - 1 : 0);
+	}
+	
+	// the last queue is for threads that aren't ours
+	std::vector<Queue> queues(threads + 1);
+	_queues.swap(queues);
+	
+	for(int i=0; i < threads; i++)
+		_workers.push_back( std::thread(&ThreadPool::workerLoop, this, (size_t)i) );
+}
+
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(_sleep_mutex);
+		
+		_quit = true;
+	}
+	
+	_wake.notify_all();
+	
+	for(size_t i=0; i < _workers.size(); i++)
+		_workers[i].join();
+}
+
+
+ThreadPool &
+ThreadPool::Global()
+{
+	static ThreadPool pool;
+	
+	return pool;
+}
+
+
+// queue index of the worker running on this thread, if it is one
+static thread_local const ThreadPool *t_pool = NULL;
+static thread_local size_t t_queue = 0;
+
+
+void
+ThreadPool::parallelFor(size_t count, const std::function<void (size_t)> &task)
+{
+	if(count == 0)
+		return;
+	
+	Job job;
+	
+	job.task = &task;
+	job.remaining = count;
+	
+	const bool our_worker = (t_pool == this);
+	const size_t own_queue = (our_worker ? t_queue : _queues.size() - 1);
+	
+	
+	// Counted before they're queued, so take() never decrements past zero
+	// when a worker that's already awake gets to an item first.
+	{
+		std::lock_guard<std::mutex> lock(_sleep_mutex);
+		
+		_queued += count;
+	}
+	
+	// Deal the items out round robin, starting somewhere different every
+	// time so small jobs from different threads don't all pile on worker 0.
+	const size_t first = _next_queue++;
+	
+	for(size_t i=0; i < count; i++)
+	{
+		Queue &queue = _queues[(first + i) % _queues.size()];
+		
+		const Item item = { &job, i };
+		
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		
+		queue.items.push_back(item);
+	}
+	
+	_wake.notify_all();
+	
+	
+	// help out until our job is done
+	while(job.remaining > 0)
+	{
+		Item item;
+		
+		if( take(own_queue, item) )
+		{
+			run(item);
+		}
+		else
+		{
+			// whatever is left is being run by someone else
+			std::unique_lock<std::mutex> lock(job.mutex);
+			
+			job.done.wait(lock, [&job] { return job.remaining == 0; });
+		}
+	}
+	
+	
+	// the last item's thread may still be holding the job's mutex
+	{
+		std::lock_guard<std::mutex> lock(job.mutex);
+	}
+	
+	if(job.error)
+		std::rethrow_exception(job.error);
+}
+
+
+void
+ThreadPool::workerLoop(size_t queue)
+{
+	t_pool = this;
+	t_queue = queue;
+	
+	ConverterTrace::SetThreadName("pool worker", (int)queue);
+	
+	while(true)
+	{
+		Item item;
+		
+		if( take(queue, item) )
+		{
+			run(item);
+		}
+		else
+		{
+			std::unique_lock<std::mutex> lock(_sleep_mutex);
+			
+			_wake.wait(lock, [this] { return _quit || _queued > 0; });
+			
+			if(_quit)
+				return;
+		}
+	}
+}
+
+
+bool
+ThreadPool::take(size_t queue, Item &item)
+{
+	// own queue first, from the front
+	{
+		Queue &own = _queues[queue];
+		
+		std::lock_guard<std::mutex> lock(own.mutex);
+		
+		if( !own.items.empty() )
+		{
+			item = own.items.front();
+			own.items.pop_front();
+			
+			_queued--;
+			
+			return true;
+		}
+	}
+	
+	// then steal from the back of the others
+	for(size_t i=1; i < _queues.size(); i++)
+	{
+		Queue &victim = _queues[(queue + i) % _queues.size()];
+		
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		
+		if( !victim.items.empty() )
+		{
+			item = victim.items.back();
+			victim.items.pop_back();
+			
+			_queued--;
+			
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+
+void
+ThreadPool::run(const Item &item)
+{
+	Job &job = *item.job;
+	
+	try
+	{
+		(*job.task)(item.index);
+	}
+	catch(...)
+	{
+		std::lock_guard<std::mutex> lock(job.mutex);
+		
+		if(!job.error)
+			job.error = std::current_exception();
+	}
+	
+	// the job lives on the stack of the thread waiting for it, which takes
+	// the mutex before letting it go
+	std::lock_guard<std::mutex> lock(job.mutex);
+	
+	if(--job.remaining == 0)
+		job.done.notify_all();
+}
@@ -0,0 +1,115 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_ThreadPool.h
+//
+// Persistent work-stealing thread pool
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_THREADPOOL_H
+#define INCLUDED_DCI_CONVERTER_THREADPOOL_H
+
+
+#include <stddef.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Worker threads are started once and reused for every frame.  Each worker
+// has its own queue: it takes work from the front of its own and, when that
+// runs dry, steals from the back of the others'.  The thread that calls
+// parallelFor() works too instead of just waiting, so a pool with no
+// workers at all still gets the job done, and parallelFor() can be called
+// from inside a task or from several threads at once.
+
+class ThreadPool
+{
+  public:
+	// Worker threads, not counting the caller.  0 means the caller does
+	// everything, negative means one per hardware thread less the caller.
+	ThreadPool(int threads = -1);
+	~ThreadPool();
+	
+	int threads() const { return (int)_workers.size(); }
+	
+	// Runs task(i) for every i in 0 to count-1 and returns when they have all
+	// finished.  The first exception a task throws is rethrown here.
+	void parallelFor(size_t count, const std::function<void (size_t)> &task);
+	
+	// shared by everyone in the process, created on first use
+	static ThreadPool &Global();
+	
+  private:
+	struct Job {
+		const std::function<void (size_t)> *task;
+		std::atomic<size_t> remaining;
+		std::exception_ptr error;
+		std::mutex mutex;
+		std::condition_variable done;
+	};
+	
+	typedef struct {
+		Job *job;
+		size_t index;
+	} Item;
+	
+	typedef struct Queue {
+		std::mutex mutex;
+		std::deque<Item> items;
+	} Queue;
+	
+	std::vector<std::thread> _workers;
+	std::vector<Queue> _queues; // one per worker, plus one for outside threads
+	
+	std::atomic<size_t> _queued; // raised before items are pushed, lowered as they're taken
+	std::atomic<size_t> _next_queue;
+	
+	std::mutex _sleep_mutex;
+	std::condition_variable _wake;
+	bool _quit;
+	
+	void workerLoop(size_t queue);
+	
+	bool take(size_t queue, Item &item);
+	void run(const Item &item);
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_THREADPOOL_H
@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Trace.cpp
+//
+// Timeline of what every thread was doing, for chrome://tracing or Perfetto
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter_Trace.h"
+
+#include "IexBaseExc.h"
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+
+std::atomic<bool> ConverterTrace::_enabled(false);
+
+
+namespace {
+
+typedef struct Event {
+	const char *name;
+	const char *category;
+	ConverterTrace::Clock::time_point start;
+	ConverterTrace::Clock::time_point end;
+	long long arg;
+} Event;
+
+
+// Only its own thread writes to a ring.  Rings are kept after their thread
+// exits, so a pool that has shrunk still shows what its threads did.
+typedef struct Ring {
+	int tid;
+	std::string name;
+	std::vector<Event> events;
+	std::atomic<size_t> written; // ever, the newest is at (written - 1) % size
+} Ring;
+
+
+static std::mutex g_mutex;
+static std::vector< std::unique_ptr<Ring> > g_rings;
+static size_t g_capacity = 65536;
+static ConverterTrace::Clock::time_point g_epoch = ConverterTrace::Clock::now();
+
+static thread_local Ring *t_ring = NULL;
+static thread_local char t_name[64] = "";
+
+
+static Ring &
+ThreadRing()
+{
+	if(t_ring == NULL)
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		
+		std::unique_ptr<Ring> ring(new Ring);
+		
+		ring->tid = (int)g_rings.size() + 1;
+		ring->name = t_name;
+		ring->events.resize(g_capacity);
+		ring->written = 0;
+		
+		t_ring = ring.get();
+		
+		g_rings.push_back( std::move(ring) );
+	}
+	
+	return *t_ring;
+}
+
+
+static void
+WriteString(FILE *file, const char *str)
+{
+	putc('"', file);
+	
+	for(const char *c = str; *c != '\0'; c++)
+	{
+		if(*c == '"' || *c == '\\')
+			fprintf(file, "\\%c", *c);
+		else if((unsigned char)*c < 0x20)
+			fprintf(file, "\\u%04x", (unsigned int)(unsigned char)*c);
+		else
+			putc(*c, file);
+	}
+	
+	putc('"', file);
+}
+
+
+static double
+Microseconds(ConverterTrace::Clock::duration duration)
+{
+	return std::chrono::duration<double, std::micro>(duration).count();
+}
+
+} // namespace
+
+
+void
+ConverterTrace::Start(size_t eventsPerThread)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	
+	g_capacity = (eventsPerThread > 0 ? eventsPerThread : 1);
+	g_epoch = Clock::now();
+	
+	for(size_t i=0; i < g_rings.size(); i++)
+	{
+		g_rings[i]->events.assign(g_capacity, Event());
+		g_rings[i]->written = 0;
+	}
+	
+	_enabled.store(true, std::memory_order_relaxed);
+}
+
+
+void
+ConverterTrace::SetThreadName(const char *name, int index)
+{
+	if(index >= 0)
+		snprintf(t_name, sizeof(t_name), "%s %d", name, index);
+	else
+		snprintf(t_name, sizeof(t_name), "%s", name);
+	
+	if(t_ring != NULL)
+	{
+		std::lock_guard<std::mutex> lock(g_mutex);
+		
+		t_ring->name = t_name;
+	}
+}
+
+
+void
+ConverterTrace::Record(const char *name, const char *category,
+						Clock::time_point start, Clock::time_point end, long long arg)
+{
+	if( !Enabled() )
+		return;
+	
+	Ring &ring = ThreadRing();
+	
+	const size_t written = ring.written.load(std::memory_order_relaxed);
+	
+	Event &event = ring.events[written % ring.events.size()];
+	
+	event.name = name;
+	event.category = category;
+	event.start = start;
+	event.end = end;
+	event.arg = arg;
+	
+	ring.written.store(written + 1, std::memory_order_release);
+}
+
+
+void
+ConverterTrace::WriteChromeTrace(FILE *file)
+{
+	std::lock_guard<std::mutex> lock(g_mutex);
+	
+	size_t dropped = 0;
+	
+	fprintf(file, "{\"traceEvents\":[\n");
+	fprintf(file, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"DCI converter\"}}");
+	
+	for(size_t r=0; r < g_rings.size(); r++)
+	{
+		const Ring &ring = *g_rings[r];
+		
+		const size_t written = ring.written.load(std::memory_order_acquire);
+		const size_t size = ring.events.size();
+		const size_t kept = (written < size ? written : size);
+		
+		dropped += written - kept;
+		
+		if( !ring.name.empty() )
+		{
+			fprintf(file, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", ring.tid);
+			WriteString(file, ring.name.c_str());
+			fprintf(file, "}}");
+		}
+		
+		// oldest first
+		for(size_t i = written - kept; i < written; i++)
+		{
+			const Event &event = ring.events[i % size];
+			
+			fprintf(file, ",\n{\"name\":");
+			WriteString(file, event.name);
+			fprintf(file, ",\"cat\":");
+			WriteString(file, event.category);
+			fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+						ring.tid, Microseconds(event.start - g_epoch), Microseconds(event.end - event.start));
+			
+			if(event.arg >= 0)
+				fprintf(file, ",\"args\":{\"n\":%lld}", event.arg);
+			
+			fprintf(file, "}");
+		}
+	}
+	
+	fprintf(file, "\n],\n\"displayTimeUnit\":\"ms\",\n\"otherData\":{\"dropped_spans\":\"%lu\"}}\n", (unsigned long)dropped);
+}
+
+
+void
+ConverterTrace::WriteChromeTrace(const std::string &path)
+{
+	FILE *file = fopen(path.c_str(), "w");
+	
+	if(file == NULL)
+		throw Iex::IoExc("Unable to open " + path);
+	
+	WriteChromeTrace(file);
+	
+	const bool written = (ferror(file) == 0);
+	
+	if(fclose(file) != 0 || !written)
+		throw Iex::IoExc("Unable to write " + path);
+}
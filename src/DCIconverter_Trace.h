@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *       Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *       Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// DCIconverter_Trace.h
+//
+// Timeline of what every thread was doing, for chrome://tracing or Perfetto
+//
+// ------------------------------------------------------------------------
+
+#ifndef INCLUDED_DCI_CONVERTER_TRACE_H
+#define INCLUDED_DCI_CONVERTER_TRACE_H
+
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+
+// Records spans of time (reading a frame, converting a tile, waiting on a
+// queue) into a ring buffer per thread, and writes them out as Chrome trace
+// event JSON.  Off until Start(), and then a span is two clock reads and a
+// store into memory only its own thread touches.  When a thread fills its
+// ring the oldest spans are overwritten, so a long run keeps its end.
+//
+// Names and categories are kept as pointers, so they have to be string
+// literals or otherwise live until the trace is written.  Write the trace
+// once the conversions being traced have finished.
+
+class ConverterTrace
+{
+  public:
+	typedef std::chrono::steady_clock Clock;
+	
+	// Clears anything recorded so far.  Each thread's ring holds
+	// eventsPerThread spans.
+	static void Start(size_t eventsPerThread = 65536);
+	static void Stop() { _enabled.store(false, std::memory_order_relaxed); }
+	static bool Enabled() { return _enabled.load(std::memory_order_relaxed); }
+	
+	// What the timeline calls the calling thread, "reader 2" for a name of
+	// "reader" and an index of 2.  Can be called before Start().
+	static void SetThreadName(const char *name, int index = -1);
+	
+	// A span that has already happened.  arg shows up as the span's "n"
+	// argument (a frame or tile number) unless it's negative.
+	static void Record(const char *name, const char *category,
+						Clock::time_point start, Clock::time_point end, long long arg = -1);
+	
+	static void WriteChromeTrace(FILE *file);
+	static void WriteChromeTrace(const std::string &path);
+	
+	// Records the scope it's declared in.
+	class Span
+	{
+	  public:
+		Span(const char *name, const char *category, long long arg = -1) :
+			_name(name), _category(category), _arg(arg), _running( Enabled() )
+		{
+			if(_running)
+				_start = Clock::now();
+		}
+		
+		~Span()
+		{
+			if(_running)
+				Record(_name, _category, _start, Clock::now(), _arg);
+		}
+		
+	  private:
+		const char *_name;
+		const char *_category;
+		const long long _arg;
+		const bool _running;
+		Clock::time_point _start;
+	};
+	
+  private:
+	static std::atomic<bool> _enabled;
+};
+
+
+#endif // INCLUDED_DCI_CONVERTER_TRACE_H
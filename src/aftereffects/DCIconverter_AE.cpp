@@ -40,10 +40,13 @@
 #include "DCIconverter_AE.h"
 
 #include "DCIconverter.h"
+#include "DCIconverter_Cache.h"
 
 
 #include "AEGP_SuiteHandler.h"
 
+#include <string.h>
+
 
 static PF_Err 
 About(	
@@ -285,56 +288,6 @@ static PF_Err PreRender(
 }
 
 
-template <typename CHAN_TYPE>
-static inline float ConvertToFloat(CHAN_TYPE in);
-
-template <>
-static inline float ConvertToFloat(A_u_char in)
-{
-	return (float)in / (float)PF_MAX_CHAN8;
-}
-
-template <>
-static inline float ConvertToFloat(A_u_short in)
-{
-	return (float)in / (float)PF_MAX_CHAN16;
-}
-
-template <>
-static inline float ConvertToFloat(PF_FpShort in)
-{
-	return in;
-}
-
-
-static inline float Clamp(float in)
-{
-	return (in >= 1.f ? 1.f : in <= 0.f ? 0.f : in);
-}
-
-
-template <typename CHAN_TYPE>
-static inline CHAN_TYPE ConvertToAE(float in);
-
-template <>
-static inline A_u_char ConvertToAE<A_u_char>(float in)
-{
-	return ( Clamp(in) * (float)PF_MAX_CHAN8 ) + 0.5f;
-}
-
-template <>
-static inline A_u_short ConvertToAE<A_u_short>(float in)
-{
-	return ( Clamp(in) * (float)PF_MAX_CHAN16 ) + 0.5f;
-}
-
-template <>
-static inline PF_FpShort ConvertToAE<PF_FpShort>(float in)
-{
-	return in;
-}
-
-
 template <typename T>
 struct PremierePixel {
 	T blue;
@@ -347,8 +300,62 @@ struct PremierePixel {
 typedef struct {
 	A_long					width;
 	const DCIconverterBase	*converter;
+	bool					constant;	// every input pixel is the same, use fill
+	float					fill[3];
 } ProcessData;
 
+
+template <typename WP_PIXTYPE>
+static bool
+SamePixel(const WP_PIXTYPE &a, const WP_PIXTYPE &b)
+{
+	// bit for bit, so -0 and NaNs are not folded together
+	return !memcmp(&a.red, &b.red, sizeof(a.red)) &&
+			!memcmp(&a.green, &b.green, sizeof(a.green)) &&
+			!memcmp(&a.blue, &b.blue, sizeof(a.blue));
+}
+
+
+// Slates, mattes and solids are common enough that it is worth a quick look
+// before rendering. If every pixel in the input world has the same color,
+// convert it once and have ProcessRow fill the output with the result.
+// Only the pixels in area are looked at.
+template <typename WP_PIXTYPE, typename CHAN_TYPE>
+static bool
+ConstantFrame(const PF_EffectWorld *world, const PF_Rect &area, const DCIconverterBase &converter, float fill[3])
+{
+	const A_long left = mmax(area.left, 0);
+	const A_long top = mmax(area.top, 0);
+	const A_long right = mmin(area.right, world->width);
+	const A_long bottom = mmin(area.bottom, world->height);
+	
+	if(left >= right || top >= bottom)
+		return false;
+	
+	const WP_PIXTYPE *first = (const WP_PIXTYPE *)((const char *)world->data + (top * world->rowbytes)) + left;
+	
+	for(A_long y = top; y < bottom; y++)
+	{
+		const WP_PIXTYPE *pix = (const WP_PIXTYPE *)((const char *)world->data + (y * world->rowbytes));
+		
+		for(A_long x = left; x < right; x++)
+		{
+			if( !SamePixel(pix[x], *first) )
+				return false;
+		}
+	}
+	
+	CHAN_TYPE in[3] = { first->red, first->green, first->blue };
+	CHAN_TYPE out[3];
+	
+	converter.convertSpan(in, out, 1);
+	
+	for(int c=0; c < 3; c++)
+		fill[c] = out[c];
+	
+	return true;
+}
+
 template <typename AE_PIXTYPE, typename WP_PIXTYPE, typename CHAN_TYPE>
 static PF_Err
 ProcessRow(
@@ -363,26 +370,66 @@ ProcessRow(
 	WP_PIXTYPE *in = (WP_PIXTYPE *)inP;
 	WP_PIXTYPE *out = (WP_PIXTYPE *)outP;
 	
-	for(int x=0; x < p_data->width; x++)
+	if(p_data->constant)
+	{
+		const CHAN_TYPE red = p_data->fill[0];
+		const CHAN_TYPE green = p_data->fill[1];
+		const CHAN_TYPE blue = p_data->fill[2];
+		
+		for(int i=0; i < p_data->width; i++)
+		{
+			out[i].red   = red;
+			out[i].green = green;
+			out[i].blue  = blue;
+			
+			out[i].alpha = in[i].alpha;
+		}
+		
+		return PF_Err_NONE;
+	}
+	
+	// Work through the row in chunks so we only call the converter once per chunk.
+	// Pixels stay in their own channel type, so 8 and 16-bit frames go through
+	// the converter's integer pipeline and never become float. Runs of identical
+	// pixels (flat backgrounds, letterboxing) are converted once by convertRuns().
+	const int chunk_size = 256;
+	
+	CHAN_TYPE buf[chunk_size * 3];
+	
+	for(int done=0; done < p_data->width; done += chunk_size)
 	{
-		Pixel inpix;
+		const int count = mmin(chunk_size, p_data->width - done);
 		
-		inpix[0] = ConvertToFloat( in->red );
-		inpix[1] = ConvertToFloat( in->green );
-		inpix[2] = ConvertToFloat( in->blue );
+		CHAN_TYPE *pix = buf;
 		
+		for(int i=0; i < count; i++)
+		{
+			pix[0] = in[i].red;
+			pix[1] = in[i].green;
+			pix[2] = in[i].blue;
+			
+			pix += 3;
+		}
 		
-		Pixel outpix = p_data->converter->convert(inpix);
 		
+		p_data->converter->convertRuns(buf, buf, count);
 		
-		out->red   = ConvertToAE<CHAN_TYPE>( outpix[0] );
-		out->green = ConvertToAE<CHAN_TYPE>( outpix[1] );
-		out->blue  = ConvertToAE<CHAN_TYPE>( outpix[2] );
 		
-		out->alpha = in->alpha;
+		pix = buf;
 		
-		in++;
-		out++;
+		for(int i=0; i < count; i++)
+		{
+			out[i].red   = pix[0];
+			out[i].green = pix[1];
+			out[i].blue  = pix[2];
+			
+			out[i].alpha = in[i].alpha;
+			
+			pix += 3;
+		}
+		
+		in += count;
+		out += count;
 	}
 
 	return PF_Err_NONE;
@@ -440,12 +487,39 @@ static PF_Err DoRender(
 			
 			origin.h = in_data->output_origin_x;
 			origin.v = in_data->output_origin_y;
-
-			areaR.left		= 0;
-			areaR.right		= 1;
 			
-			areaR.top		= 0;
-			areaR.bottom	= output->height;
+			// Only the part of the output the host asked for (we set
+			// PF_OutFlag_USE_OUTPUT_EXTENT), which is less than the whole
+			// frame when the comp window is zoomed in or has a region of
+			// interest.  An empty hint gets the whole frame.
+			PF_Rect roi = output->extent_hint;
+			
+			roi.left	= mmax(roi.left, 0);
+			roi.top		= mmax(roi.top, 0);
+			roi.right	= mmin(roi.right, output->width);
+			roi.bottom	= mmin(roi.bottom, output->height);
+			
+			if(roi.left >= roi.right || roi.top >= roi.bottom)
+			{
+				roi.left = roi.top = 0;
+				roi.right = output->width;
+				roi.bottom = output->height;
+			}
+			
+			// the same pixels in the input
+			PF_Rect inputR = roi;
+			
+			inputR.left		+= origin.h;
+			inputR.right	+= origin.h;
+			inputR.top		+= origin.v;
+			inputR.bottom	+= origin.v;
+			
+			// ProcessRow is called once per row, with the row's first pixel
+			areaR.left		= roi.left;
+			areaR.right		= roi.left + 1;
+			
+			areaR.top		= roi.top;
+			areaR.bottom	= roi.bottom;
 			
 			
 			PF_ParamValue operation		= DCI_operation->u.pd.value;
@@ -477,28 +551,32 @@ static PF_Err DoRender(
 																adaptationP == ADAPTATION_DCI ? DCIconverterBase::DCI :
 																DCIconverterBase::Temp;
 			
-			const DCIconverterBase *converter = NULL;
+			// Draft renders get the quick pow approximation in 32-bit.
+			// 8 and 16-bit go through tables either way.
+			DCIconverterBase::Precision precision = (in_data->quality == PF_Quality_LO ?
+														DCIconverterBase::Accurate12 : DCIconverterBase::Exact);
 			
-			if(operation == OPERATION_XYZ_TO_RGB)
-			{
-				converter = new ReverseDCIconverter(curve, gamma, color, adaptation, temperature, normalize, xyz_gamma);
-			}
-			else
-			{
-				converter = new ForwardDCIconverter(curve, gamma, color, adaptation, temperature, normalize, xyz_gamma);
-			}
+			// Converters are shared between frames and render threads,
+			// so one is only built when the parameters change.
+			static ConverterCache converter_cache;
+			
+			ConverterCache::ConverterPtr converter = converter_cache.get(operation != OPERATION_XYZ_TO_RGB,
+																		curve, gamma, color, adaptation, temperature,
+																		normalize, xyz_gamma, precision);
 			
 			
 			if(converter)
 			{
-				ProcessData p_data = { output->width, converter };
+				ProcessData p_data = { roi.right - roi.left, converter.get(), false, { 0.f, 0.f, 0.f } };
 				
 			
 				if(format == PF_PixelFormat_ARGB32)
 				{
+					p_data.constant = ConstantFrame<PF_Pixel, A_u_char>(input, inputR, *converter, p_data.fill);
+					
 					err = suites.Iterate8Suite1()->iterate_origin(in_data,
 																	0,
-																	output->height,
+																	roi.bottom - roi.top,
 																	input,
 																	&areaR,
 																	&origin,
@@ -508,9 +586,11 @@ static PF_Err DoRender(
 				}
 				else if(format == PF_PixelFormat_ARGB64)
 				{
+					p_data.constant = ConstantFrame<PF_Pixel16, A_u_short>(input, inputR, *converter, p_data.fill);
+					
 					err = suites.Iterate16Suite1()->iterate_origin(in_data,
 																	0,
-																	output->height,
+																	roi.bottom - roi.top,
 																	input,
 																	&areaR,
 																	&origin,
@@ -520,9 +600,11 @@ static PF_Err DoRender(
 				}
 				else if(format == PF_PixelFormat_ARGB128)
 				{
+					p_data.constant = ConstantFrame<PF_Pixel32, PF_FpShort>(input, inputR, *converter, p_data.fill);
+					
 					err = suites.IterateFloatSuite1()->iterate_origin(in_data,
 																	0,
-																	output->height,
+																	roi.bottom - roi.top,
 																	input,
 																	&areaR,
 																	&origin,
@@ -532,9 +614,11 @@ static PF_Err DoRender(
 				}
 				else if(format == PrPixelFormat_BGRA_4444_8u)
 				{
+					p_data.constant = ConstantFrame<PremierePixel<A_u_char>, A_u_char>(input, inputR, *converter, p_data.fill);
+					
 					err = suites.Iterate8Suite1()->iterate_origin(in_data,
 																	0,
-																	output->height,
+																	roi.bottom - roi.top,
 																	input,
 																	&areaR,
 																	&origin,
@@ -544,9 +628,11 @@ static PF_Err DoRender(
 				}
 				else if(format == PrPixelFormat_BGRA_4444_16u)
 				{
+					p_data.constant = ConstantFrame<PremierePixel<A_u_short>, A_u_short>(input, inputR, *converter, p_data.fill);
+					
 					err = suites.Iterate8Suite1()->iterate_origin(in_data,
 																	0,
-																	output->height,
+																	roi.bottom - roi.top,
 																	input,
 																	&areaR,
 																	&origin,
@@ -556,9 +642,11 @@ static PF_Err DoRender(
 				}
 				else if(format == PrPixelFormat_BGRA_4444_32f)
 				{
+					p_data.constant = ConstantFrame<PremierePixel<PF_FpShort>, PF_FpShort>(input, inputR, *converter, p_data.fill);
+					
 					err = suites.Iterate8Suite1()->iterate_origin(in_data,
 																	0,
-																	output->height,
+																	roi.bottom - roi.top,
 																	input,
 																	&areaR,
 																	&origin,
@@ -566,9 +654,6 @@ static PF_Err DoRender(
 																	ProcessRow<PF_Pixel, PremierePixel<PF_FpShort>, PF_FpShort>,
 																	output);
 				}
-				
-				
-				delete converter;
 			}
 		}
 		catch(...) { err = PF_Err_INTERNAL_STRUCT_DAMAGED; }
@@ -0,0 +1,1045 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// dciaudit.cpp
+//
+// Accuracy of the fast conversion paths against a double precision reference
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter.h"
+#include "DCIconverter_LUT.h"
+#include "DCIconverter_Reference.h"
+#include "DCIconverter_ThreadPool.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+typedef enum {
+	In32f,
+	In8u,
+	In16u,
+	In16f
+} InputType;
+
+typedef enum {
+	Out32f,
+	Out8u,
+	Out16u,
+	Out16f,
+	OutDCDM
+} OutputType;
+
+typedef struct {
+	const char *name;
+	InputType input;
+	OutputType output;
+	bool forward_only;
+	bool lossy; // trades accuracy for speed on purpose, reported but not held to the tolerance
+	const char *description;
+} Path;
+
+// DCDM code values (SMPTE 428-1) are 12-bit integers, so a forward path may
+// be off by one of them and still land on the right code or its neighbour.
+// Integer output can't do better than one of its own codes either, so
+// 8-bit output is allowed that and 16-bit output the eight of its codes that
+// make a DCDM code.  Reverse output is R'G'B', which DCDM says nothing about,
+// and near black the inverse 1/2.6 gammas turn float rounding into codes, so
+// it's reported but not held to it.
+static const double g_tolerance = 1.0;
+
+static const Path g_paths[] = {
+	{ "scalar",		In32f,	Out32f,		false,	false,	"convert(), one pixel at a time" },
+	{ "span-32f",	In32f,	Out32f,		false,	false,	"float convertSpan(), SIMD kernel if there is one" },
+	{ "p16-32f",	In32f,	Out32f,		false,	false,	"float convertSpan(), Accurate16 pow approximation" },
+	{ "p12-32f",	In32f,	Out32f,		false,	false,	"float convertSpan(), Accurate12 pow approximation" },
+	{ "span-8u",	In8u,	Out32f,		false,	false,	"8-bit to float convertSpan(), input curve table" },
+	{ "span-16u",	In16u,	Out32f,		false,	false,	"16-bit to float convertSpan(), input curve table" },
+	{ "span-16f",	In16f,	Out32f,		false,	false,	"half to float convertSpan(), input curve table" },
+	{ "half-16f",	In16f,	Out16f,		false,	true,	"half to half convertSpan(), input and output curve tables" },
+	{ "int-8u",		In8u,	Out8u,		false,	false,	"8-bit to 8-bit convertSpan(), through float" },
+	{ "int-16u",	In16u,	Out16u,		false,	false,	"16-bit to 16-bit convertSpan(), through float" },
+	{ "fixed-8u",	In8u,	Out8u,		false,	false,	"8-bit to 8-bit fixed-point pipeline, Accurate16" },
+	{ "fixed-16u",	In16u,	Out16u,		false,	false,	"16-bit to 16-bit fixed-point pipeline, Accurate16" },
+	{ "dcdm-32f",	In32f,	OutDCDM,	true,	false,	"float to 12-bit DCDM codes" },
+	{ "dcdm-16u",	In16u,	OutDCDM,	true,	false,	"16-bit to 12-bit DCDM codes" },
+	{ "lut33-32f",	In32f,	Out32f,		false,	true,	"33-point LUT, tetrahedral interpolation" }
+};
+
+typedef struct {
+	const char *name;
+	DCIconverterBase::ResponseCurve curve;
+} Curve;
+
+static const Curve g_curves[] = {
+	{ "sRGB", DCIconverterBase::sRGB },
+	{ "Rec709", DCIconverterBase::Rec709 },
+	{ "ProPhoto", DCIconverterBase::ProPhotoRGB },
+	{ "P3", DCIconverterBase::P3 },
+	{ "Linear", DCIconverterBase::Linear },
+	{ "Gamma", DCIconverterBase::Gamma }
+};
+
+typedef struct {
+	const char *name;
+	DCIconverterBase::ColorSpace color;
+} Primaries;
+
+static const Primaries g_primaries[] = {
+	{ "709-primaries", DCIconverterBase::sRGB_Rec709 },
+	{ "ProPhoto-primaries", DCIconverterBase::ProPhotoRGB_ROMM },
+	{ "P3-primaries", DCIconverterBase::P3_RGB }
+};
+
+typedef struct {
+	const char *name;
+	DCIconverterBase::ChromaticAdaptation adaptation;
+} Adaptation;
+
+static const Adaptation g_adaptations[] = {
+	{ "None", DCIconverterBase::None },
+	{ "D50", DCIconverterBase::D50 },
+	{ "D55", DCIconverterBase::D55 },
+	{ "D60", DCIconverterBase::D60 },
+	{ "D65", DCIconverterBase::D65 },
+	{ "DCI", DCIconverterBase::DCI },
+	{ "Temp", DCIconverterBase::Temp }
+};
+
+#define COUNT(ARRAY) (sizeof(ARRAY) / sizeof(ARRAY[0]))
+
+
+typedef struct {
+	bool quick;
+	bool exhaustive;
+	bool verbose;
+	int threads;
+	int grid;
+	std::string only;
+	std::string json_path;
+} Options;
+
+
+static void
+Usage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Runs every fast conversion path for every direction, curve, color space,\n"
+		"adaptation and normalize setting, and compares the results with a double\n"
+		"precision reference.  Error is reported in code values of the path's\n"
+		"output, 12-bit DCDM codes for float output, and as CIE 1976 delta E, both\n"
+		"after rounding the reference to the path's output depth, so they measure\n"
+		"the path and not the depth.\n"
+		"\n"
+		"Integer input runs through every code value in every channel, float input\n"
+		"through a jittered grid.\n"
+		"\n"
+		"  -q, --quick          sRGB, Rec709 and P3 curves, None, D65 and Temp adaptation\n"
+		"  -x, --exhaustive     every 8-bit RGB triple (16.7 million per configuration)\n"
+		"  -o, --only TEXT      only configurations and paths whose name contains TEXT\n"
+		"  -g, --grid N         float samples per channel (65)\n"
+		"  -j, --threads N      threads to audit with (all of them)\n"
+		"  -w, --json FILE      write results as JSON, - for stdout\n"
+		"  -v, --verbose        print every configuration, not just the worst\n"
+		"\n"
+		"A path is out of tolerance if any forward X'Y'Z' output is further from\n"
+		"the reference than one 12-bit DCDM code, or one of its own codes if that\n"
+		"is coarser.  Reverse output is reported but not held to it, and neither\n"
+		"are the LUT and half to half paths, which are lossy by design.  The exit\n"
+		"code is 2 if any path is out of tolerance.\n",
+		program);
+}
+
+
+static bool
+ParseArgs(int argc, char *argv[], Options &opt)
+{
+	opt.quick = false;
+	opt.exhaustive = false;
+	opt.verbose = false;
+	opt.threads = 0;
+	opt.grid = 65;
+	
+	for(int i=1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const char *value = (i + 1 < argc ? argv[i + 1] : NULL);
+		
+		if(arg == "-q" || arg == "--quick")
+		{
+			opt.quick = true;
+			continue;
+		}
+		else if(arg == "-x" || arg == "--exhaustive")
+		{
+			opt.exhaustive = true;
+			continue;
+		}
+		else if(arg == "-v" || arg == "--verbose")
+		{
+			opt.verbose = true;
+			continue;
+		}
+		else if(value == NULL)
+		{
+			return false;
+		}
+		
+		i++;
+		
+		if(arg == "-o" || arg == "--only")
+			opt.only = value;
+		else if(arg == "-g" || arg == "--grid")
+			opt.grid = atoi(value);
+		else if(arg == "-j" || arg == "--threads")
+			opt.threads = atoi(value);
+		else if(arg == "-w" || arg == "--json")
+			opt.json_path = value;
+		else
+			return false;
+	}
+	
+	return (opt.grid >= 2);
+}
+
+
+typedef struct {
+	std::string name;
+	bool forward;
+	DCIconverterBase::ResponseCurve curve;
+	DCIconverterBase::ColorSpace color;
+	DCIconverterBase::ChromaticAdaptation adaptation;
+	bool normalize;
+} Config;
+
+static const float g_gamma = 2.2f;
+static const int g_temperature = 5900;
+static const float g_xyz_gamma = 2.6f;
+
+
+static void
+MakeConfigs(const Options &opt, std::vector<Config> &configs)
+{
+	for(int forward = 1; forward >= 0; forward--)
+	{
+		for(size_t c=0; c < COUNT(g_curves); c++)
+		{
+			const Curve &curve = g_curves[c];
+			
+			if(opt.quick && curve.curve != DCIconverterBase::sRGB &&
+							curve.curve != DCIconverterBase::Rec709 &&
+							curve.curve != DCIconverterBase::P3)
+				continue;
+			
+			for(size_t p=0; p < COUNT(g_primaries); p++)
+			{
+				for(size_t a=0; a < COUNT(g_adaptations); a++)
+				{
+					const Adaptation &adaptation = g_adaptations[a];
+					
+					if(opt.quick && adaptation.adaptation != DCIconverterBase::None &&
+									adaptation.adaptation != DCIconverterBase::D65 &&
+									adaptation.adaptation != DCIconverterBase::Temp)
+						continue;
+					
+					for(int normalize = 1; normalize >= 0; normalize--)
+					{
+						Config config;
+						
+						config.name = std::string(forward ? "forward" : "reverse") + "/" + curve.name + "/" +
+										g_primaries[p].name + "/" + adaptation.name + "/" +
+										(normalize ? "norm" : "nonorm");
+						config.forward = (forward != 0);
+						config.curve = curve.curve;
+						config.color = g_primaries[p].color;
+						config.adaptation = adaptation.adaptation;
+						config.normalize = (normalize != 0);
+						
+						configs.push_back(config);
+					}
+				}
+			}
+		}
+	}
+}
+
+
+// Sample sets.  Integer sets put every code value in every channel, once
+// as a gray and then with pseudo-random values in the other two channels.
+
+static const size_t g_companions8 = 64;
+static const size_t g_companions16 = 16;
+
+static inline unsigned int
+Hash(unsigned int a, unsigned int b)
+{
+	unsigned int h = (a * 0x9e3779b1u) ^ (b * 0x85ebca77u);
+	
+	h ^= h >> 15;
+	h *= 0x2c1b3c6du;
+	h ^= h >> 12;
+	
+	return h;
+}
+
+
+static size_t
+SampleCount(InputType type, const Options &opt)
+{
+	switch(type)
+	{
+		case In8u:	return (opt.exhaustive ? (size_t)256 * 256 * 256 : (size_t)256 * g_companions8);
+		case In16u:	return (size_t)(DCIconverterBase::MAX_CHAN16 + 1) * g_companions16;
+		default:	return (size_t)opt.grid * opt.grid * opt.grid;
+	}
+}
+
+
+static inline void
+IntSample(size_t index, unsigned int max, bool exhaustive, unsigned int code[3])
+{
+	if(exhaustive)
+	{
+		code[0] = index & 0xff;
+		code[1] = (index >> 8) & 0xff;
+		code[2] = (index >> 16) & 0xff;
+		return;
+	}
+	
+	const unsigned int v = (unsigned int)(index % (max + 1));
+	const unsigned int k = (unsigned int)(index / (max + 1));
+	
+	if(k == 0)
+	{
+		code[0] = code[1] = code[2] = v;
+	}
+	else
+	{
+		const unsigned int sweep = k % 3;
+		
+		code[sweep] = v;
+		code[(sweep + 1) % 3] = Hash(v, k * 2) % (max + 1);
+		code[(sweep + 2) % 3] = Hash(v, k * 2 + 1) % (max + 1);
+	}
+}
+
+
+static inline float
+FloatSample(size_t index, int grid, int channel)
+{
+	size_t cell = index;
+	
+	for(int c=0; c < channel; c++)
+		cell /= grid;
+	
+	const int k = (int)(cell % grid);
+	
+	// jittered inside the cell, except for the ends so 0 and 1 are covered
+	if(k == 0 || k == grid - 1)
+		return (float)k / (float)(grid - 1);
+	
+	const double jitter = (double)(Hash((unsigned int)index, channel) & 0xffff) / 65536.0 - 0.5;
+	
+	return (float)( ((double)k + jitter) / (double)(grid - 1) );
+}
+
+
+typedef struct Stats {
+	size_t count;
+	size_t codes_off; // samples that don't round to the same code
+	double max_codes;
+	double sum_codes;
+	double max_delta_e;
+	double sum_delta_e;
+	double worst_input[3];
+	
+	Stats() : count(0), codes_off(0), max_codes(0.0), sum_codes(0.0), max_delta_e(0.0), sum_delta_e(0.0)
+	{
+		worst_input[0] = worst_input[1] = worst_input[2] = 0.0;
+	}
+	
+	void add(const Stats &other)
+	{
+		if(other.max_codes > max_codes)
+		{
+			max_codes = other.max_codes;
+			
+			for(int c=0; c < 3; c++)
+				worst_input[c] = other.worst_input[c];
+		}
+		
+		if(other.max_delta_e > max_delta_e)
+			max_delta_e = other.max_delta_e;
+		
+		count += other.count;
+		codes_off += other.codes_off;
+		sum_codes += other.sum_codes;
+		sum_delta_e += other.sum_delta_e;
+	}
+} Stats;
+
+
+static inline double
+LabF(double t)
+{
+	static const double delta = 6.0 / 29.0;
+	
+	return (t > delta * delta * delta ? cbrt(t) : t / (3.0 * delta * delta) + 4.0 / 29.0);
+}
+
+
+static inline void
+XYZtoLab(const double xyz[3], const double white[3], double lab[3])
+{
+	const double fx = LabF(xyz[0] / white[0]);
+	const double fy = LabF(xyz[1] / white[1]);
+	const double fz = LabF(xyz[2] / white[2]);
+	
+	lab[0] = 116.0 * fy - 16.0;
+	lab[1] = 500.0 * (fx - fy);
+	lab[2] = 200.0 * (fy - fz);
+}
+
+
+static inline double
+Clamp01(double in)
+{
+	return (in >= 1.0 ? 1.0 : in <= 0.0 ? 0.0 : in);
+}
+
+
+static double
+OutputMax(OutputType type)
+{
+	switch(type)
+	{
+		case Out8u:		return DCIconverterBase::MAX_CHAN8;
+		case Out16u:	return DCIconverterBase::MAX_CHAN16;
+		case OutDCDM:	return DCDMencoder::MAX_CODE;
+		default:		return 0.0; // not quantized
+	}
+}
+
+
+// Codes errors are measured in: the output's own, or 12-bit DCDM codes
+// for float output, which is what it will be encoded at
+static double
+CodeMax(OutputType type)
+{
+	const double max = OutputMax(type);
+	
+	return (max > 0.0 ? max : (double)DCDMencoder::MAX_CODE);
+}
+
+
+static const char *
+CodeName(OutputType type)
+{
+	switch(type)
+	{
+		case Out8u:		return "8-bit";
+		case Out16u:	return "16-bit";
+		default:		return "12-bit";
+	}
+}
+
+
+// g_tolerance in the path's own codes
+static double
+Tolerance(const Path &path)
+{
+	const double codes = g_tolerance * CodeMax(path.output) / DCDMencoder::MAX_CODE;
+	
+	return (codes > 1.0 ? codes : 1.0);
+}
+
+
+typedef struct {
+	const DCIconverterBase *converter;
+	const DCIconverterBase *accurate16;
+	const DCIconverterBase *accurate12;
+	const LUTDCIconverter *lut;
+	const ReferenceDCIconverter *reference;
+} Converters;
+
+
+// Run one path on a chunk of samples, outputs normalized to 0-1
+static void
+RunPath(const Path &path, const Converters &conv, size_t count,
+		const std::vector<float> &in32f, const std::vector<unsigned char> &in8u,
+		const std::vector<unsigned short> &in16u, const std::vector<half> &in16f,
+		std::vector<double> &out)
+{
+	const DCIconverterBase &converter = *conv.converter;
+	
+	std::vector<float> out32f;
+	std::vector<unsigned char> out8u;
+	std::vector<unsigned short> out16u;
+	std::vector<half> out16f;
+	
+	const std::string name = path.name;
+	
+	if(name == "scalar")
+	{
+		out32f.resize(count * 3);
+		
+		for(size_t i=0; i < count; i++)
+		{
+			const Pixel pix = converter.convert( Pixel(in32f[i * 3 + 0], in32f[i * 3 + 1], in32f[i * 3 + 2]) );
+			
+			for(int c=0; c < 3; c++)
+				out32f[i * 3 + c] = pix[c];
+		}
+	}
+	else if(name == "span-32f")
+	{
+		out32f.resize(count * 3);
+		converter.convertSpan(&in32f[0], &out32f[0], count);
+	}
+	else if(name == "p16-32f")
+	{
+		out32f.resize(count * 3);
+		conv.accurate16->convertSpan(&in32f[0], &out32f[0], count);
+	}
+	else if(name == "p12-32f")
+	{
+		out32f.resize(count * 3);
+		conv.accurate12->convertSpan(&in32f[0], &out32f[0], count);
+	}
+	else if(name == "span-8u")
+	{
+		out32f.resize(count * 3);
+		converter.convertSpan(&in8u[0], &out32f[0], count);
+	}
+	else if(name == "span-16u")
+	{
+		out32f.resize(count * 3);
+		converter.convertSpan(&in16u[0], &out32f[0], count);
+	}
+	else if(name == "span-16f")
+	{
+		out32f.resize(count * 3);
+		converter.convertSpan(&in16f[0], &out32f[0], count);
+	}
+	else if(name == "half-16f")
+	{
+		out16f.resize(count * 3);
+		converter.convertSpan(&in16f[0], &out16f[0], count);
+	}
+	else if(name == "int-8u")
+	{
+		out8u.resize(count * 3);
+		converter.convertSpan(&in8u[0], &out8u[0], count);
+	}
+	else if(name == "int-16u")
+	{
+		out16u.resize(count * 3);
+		converter.convertSpan(&in16u[0], &out16u[0], count);
+	}
+	else if(name == "fixed-8u")
+	{
+		out8u.resize(count * 3);
+		conv.accurate16->convertSpan(&in8u[0], &out8u[0], count);
+	}
+	else if(name == "fixed-16u")
+	{
+		out16u.resize(count * 3);
+		conv.accurate16->convertSpan(&in16u[0], &out16u[0], count);
+	}
+	else if(name == "dcdm-32f" || name == "dcdm-16u")
+	{
+		const ForwardDCIconverter &forward = dynamic_cast<const ForwardDCIconverter &>(converter);
+		
+		out16u.resize(count * 3);
+		
+		if(path.input == In32f)
+			forward.convertSpanDCDM(&in32f[0], &out16u[0], count);
+		else
+			forward.convertSpanDCDM(&in16u[0], &out16u[0], count);
+	}
+	else if(name == "lut33-32f")
+	{
+		out32f.resize(count * 3);
+		conv.lut->convertSpan(&in32f[0], &out32f[0], count);
+	}
+	
+	
+	out.resize(count * 3);
+	
+	const double max = OutputMax(path.output);
+	
+	for(size_t i=0; i < count * 3; i++)
+	{
+		out[i] = (path.output == Out32f ? (double)out32f[i] :
+					path.output == Out16f ? (double)(float)out16f[i] :
+					path.output == Out8u ? (double)out8u[i] / max :
+					(double)out16u[i] / max);
+	}
+}
+
+
+static void
+Measure(const Path &path, const ReferenceDCIconverter &reference, size_t count,
+		const std::vector<double> &input, const std::vector<double> &expected,
+		const std::vector<double> &actual, Stats &stats)
+{
+	const double max = OutputMax(path.output);
+	const double code_max = CodeMax(path.output);
+	
+	double white[3];
+	reference.whiteXYZ(white);
+	
+	for(size_t i=0; i < count; i++)
+	{
+		double want[3], got[3];
+		
+		for(int c=0; c < 3; c++)
+		{
+			const double ref = Clamp01(expected[i * 3 + c]);
+			
+			want[c] = (max > 0.0 ? floor(ref * max + 0.5) / max : ref);
+			got[c] = Clamp01(actual[i * 3 + c]);
+		}
+		
+		double codes = 0.0;
+		bool off = false;
+		
+		for(int c=0; c < 3; c++)
+		{
+			const double got_code = got[c] * code_max;
+			const double want_code = want[c] * code_max;
+			
+			// integer outputs are off by a whole number of their own codes
+			const double diff = (max > 0.0 ? fabs(floor(got_code + 0.5) - floor(want_code + 0.5)) :
+											fabs(got_code - want_code));
+			
+			if(diff > codes)
+				codes = diff;
+			
+			if(floor(got_code + 0.5) != floor(want_code + 0.5))
+				off = true;
+		}
+		
+		double want_xyz[3], got_xyz[3], want_lab[3], got_lab[3];
+		
+		reference.outputToXYZ(want, want_xyz);
+		reference.outputToXYZ(got, got_xyz);
+		
+		XYZtoLab(want_xyz, white, want_lab);
+		XYZtoLab(got_xyz, white, got_lab);
+		
+		const double delta_e = sqrt( (got_lab[0] - want_lab[0]) * (got_lab[0] - want_lab[0]) +
+										(got_lab[1] - want_lab[1]) * (got_lab[1] - want_lab[1]) +
+										(got_lab[2] - want_lab[2]) * (got_lab[2] - want_lab[2]) );
+		
+		if(codes > stats.max_codes)
+		{
+			stats.max_codes = codes;
+			
+			for(int c=0; c < 3; c++)
+				stats.worst_input[c] = input[i * 3 + c];
+		}
+		
+		if(delta_e > stats.max_delta_e)
+			stats.max_delta_e = delta_e;
+		
+		stats.count++;
+		stats.sum_codes += codes;
+		stats.sum_delta_e += delta_e;
+		
+		if(off)
+			stats.codes_off++;
+	}
+}
+
+
+static bool
+PathSelected(const Options &opt, const Config &config, const Path &path)
+{
+	if(path.forward_only && !config.forward)
+		return false;
+	
+	const std::string name = config.name + "/" + path.name;
+	
+	return (name.find(opt.only) != std::string::npos);
+}
+
+
+// Every selected path for one configuration, a chunk of samples at a time
+static void
+AuditConfig(const Options &opt, const Config &config, std::vector<Stats> &stats)
+{
+	stats.assign(COUNT(g_paths), Stats());
+	
+	const std::unique_ptr<DCIconverterBase> converter( DCIconverterBase::Create(config.forward, config.curve, g_gamma,
+																					config.color, config.adaptation, g_temperature,
+																					config.normalize, g_xyz_gamma) );
+	
+	const ReferenceDCIconverter reference(config.forward, config.curve, g_gamma,
+											config.color, config.adaptation, g_temperature,
+											config.normalize, g_xyz_gamma);
+	
+	const std::unique_ptr<DCIconverterBase> accurate16( DCIconverterBase::Create(config.forward, config.curve, g_gamma,
+																					config.color, config.adaptation, g_temperature,
+																					config.normalize, g_xyz_gamma,
+																					DCIconverterBase::Accurate16) );
+	
+	const std::unique_ptr<DCIconverterBase> accurate12( DCIconverterBase::Create(config.forward, config.curve, g_gamma,
+																					config.color, config.adaptation, g_temperature,
+																					config.normalize, g_xyz_gamma,
+																					DCIconverterBase::Accurate12) );
+	
+	std::unique_ptr<LUTDCIconverter> lut;
+	
+	Converters conv = { converter.get(), accurate16.get(), accurate12.get(), NULL, &reference };
+	
+	
+	const InputType inputs[] = { In32f, In8u, In16u, In16f };
+	
+	for(size_t t=0; t < COUNT(inputs); t++)
+	{
+		const InputType type = inputs[t];
+		
+		bool any = false;
+		
+		for(size_t p=0; p < COUNT(g_paths); p++)
+		{
+			if(g_paths[p].input == type && PathSelected(opt, config, g_paths[p]))
+			{
+				any = true;
+				
+				if(std::string(g_paths[p].name) == "lut33-32f" && lut.get() == NULL)
+				{
+					lut.reset( new LUTDCIconverter(*converter, 33) );
+					conv.lut = lut.get();
+				}
+			}
+		}
+		
+		if(!any)
+			continue;
+		
+		
+		const size_t total = SampleCount(type, opt);
+		const size_t chunk_size = 65536;
+		
+		std::vector<float> in32f(chunk_size * 3);
+		std::vector<unsigned char> in8u(chunk_size * 3);
+		std::vector<unsigned short> in16u(chunk_size * 3);
+		std::vector<half> in16f(chunk_size * 3);
+		std::vector<double> input(chunk_size * 3);
+		std::vector<double> expected(chunk_size * 3);
+		std::vector<double> actual;
+		
+		for(size_t done=0; done < total; done += chunk_size)
+		{
+			const size_t count = (total - done < chunk_size ? total - done : chunk_size);
+			
+			for(size_t i=0; i < count; i++)
+			{
+				const size_t index = done + i;
+				
+				for(int c=0; c < 3; c++)
+				{
+					if(type == In32f)
+					{
+						in32f[i * 3 + c] = FloatSample(index, opt.grid, c);
+						input[i * 3 + c] = in32f[i * 3 + c];
+					}
+					else if(type == In16f)
+					{
+						// the reference sees the value the half actually holds
+						in16f[i * 3 + c] = FloatSample(index, opt.grid, c);
+						input[i * 3 + c] = (float)in16f[i * 3 + c];
+					}
+				}
+				
+				if(type == In8u)
+				{
+					unsigned int code[3];
+					IntSample(index, DCIconverterBase::MAX_CHAN8, opt.exhaustive, code);
+					
+					for(int c=0; c < 3; c++)
+					{
+						in8u[i * 3 + c] = (unsigned char)code[c];
+						input[i * 3 + c] = (double)code[c] / DCIconverterBase::MAX_CHAN8;
+					}
+				}
+				else if(type == In16u)
+				{
+					unsigned int code[3];
+					IntSample(index, DCIconverterBase::MAX_CHAN16, false, code);
+					
+					for(int c=0; c < 3; c++)
+					{
+						in16u[i * 3 + c] = (unsigned short)code[c];
+						input[i * 3 + c] = (double)code[c] / DCIconverterBase::MAX_CHAN16;
+					}
+				}
+				
+				reference.convert(&input[i * 3], &expected[i * 3]);
+			}
+			
+			for(size_t p=0; p < COUNT(g_paths); p++)
+			{
+				const Path &path = g_paths[p];
+				
+				if(path.input != type || !PathSelected(opt, config, path))
+					continue;
+				
+				RunPath(path, conv, count, in32f, in8u, in16u, in16f, actual);
+				
+				Measure(path, reference, count, input, expected, actual, stats[p]);
+			}
+		}
+	}
+}
+
+
+static bool
+Failed(const Path &path, const Stats &forward)
+{
+	return (!path.lossy && forward.max_codes > Tolerance(path));
+}
+
+
+static void
+WriteJSON(std::ostream &out, const std::vector<Config> &configs, const std::vector< std::vector<Stats> > &results,
+			const std::vector<Stats> &totals, const std::vector<Stats> &forward, const std::vector<Stats> &reverse)
+{
+	out << "{\n";
+	out << "  \"tolerance_dcdm_codes\": " << g_tolerance << ",\n";
+	out << "  \"paths\": [\n";
+	
+	for(size_t p=0; p < COUNT(g_paths); p++)
+	{
+		const Path &path = g_paths[p];
+		const Stats &s = totals[p];
+		
+		out << "    { \"name\": \"" << path.name << "\", \"codes\": \"" << CodeName(path.output) << "\"" <<
+				", \"tolerance\": " << Tolerance(path) << ", \"lossy\": " << (path.lossy ? "true" : "false") <<
+				", \"samples\": " << s.count <<
+				", \"max_codes\": " << s.max_codes << ", \"mean_codes\": " << (s.count ? s.sum_codes / s.count : 0.0) <<
+				", \"max_codes_forward\": " << forward[p].max_codes << ", \"max_codes_reverse\": " << reverse[p].max_codes <<
+				", \"codes_off\": " << s.codes_off <<
+				", \"max_delta_e\": " << s.max_delta_e << ", \"mean_delta_e\": " << (s.count ? s.sum_delta_e / s.count : 0.0) <<
+				", \"within_tolerance\": " << (Failed(path, forward[p]) ? "false" : "true") << " }";
+		out << (p + 1 < COUNT(g_paths) ? ",\n" : "\n");
+	}
+	
+	out << "  ],\n";
+	out << "  \"results\": [\n";
+	
+	bool first = true;
+	
+	for(size_t i=0; i < configs.size(); i++)
+	{
+		for(size_t p=0; p < COUNT(g_paths); p++)
+		{
+			const Stats &s = results[i][p];
+			
+			if(s.count == 0)
+				continue;
+			
+			if(!first)
+				out << ",\n";
+			
+			first = false;
+			
+			out << "    { \"name\": \"" << configs[i].name << "/" << g_paths[p].name << "\", \"samples\": " << s.count <<
+					", \"max_codes\": " << s.max_codes << ", \"mean_codes\": " << s.sum_codes / s.count <<
+					", \"codes_off\": " << s.codes_off <<
+					", \"max_delta_e\": " << s.max_delta_e << ", \"mean_delta_e\": " << s.sum_delta_e / s.count <<
+					", \"worst_input\": [" << s.worst_input[0] << ", " << s.worst_input[1] << ", " << s.worst_input[2] << "] }";
+		}
+	}
+	
+	out << "\n  ]\n";
+	out << "}\n";
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	Options opt;
+	
+	if( !ParseArgs(argc, argv, opt) )
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+	
+	std::vector<Config> configs;
+	MakeConfigs(opt, configs);
+	
+	std::vector< std::vector<Stats> > results(configs.size());
+	
+	try
+	{
+		ThreadPool pool(opt.threads > 0 ? opt.threads - 1 : -1);
+		
+		pool.parallelFor(configs.size(), [&](size_t i) {
+			AuditConfig(opt, configs[i], results[i]);
+		});
+	}
+	catch(const std::exception &e)
+	{
+		fprintf(stderr, "dciaudit: %s\n", e.what());
+		return 1;
+	}
+	
+	
+	std::vector<Stats> totals(COUNT(g_paths));
+	std::vector<Stats> forward(COUNT(g_paths));
+	std::vector<Stats> reverse(COUNT(g_paths));
+	std::vector<size_t> worst(COUNT(g_paths), 0);
+	
+	for(size_t i=0; i < configs.size(); i++)
+	{
+		for(size_t p=0; p < COUNT(g_paths); p++)
+		{
+			const Stats &s = results[i][p];
+			
+			if(s.count == 0)
+				continue;
+			
+			if(opt.verbose)
+			{
+				fprintf(stderr, "%-60s %9.3f max %9.4f mean codes %8.4f max %8.5f mean dE\n",
+							(configs[i].name + "/" + g_paths[p].name).c_str(),
+							s.max_codes, s.sum_codes / s.count, s.max_delta_e, s.sum_delta_e / s.count);
+			}
+			
+			// the worst forward configuration, since that's what's held to the tolerance
+			Stats &direction = (configs[i].forward ? forward[p] : reverse[p]);
+			
+			if(configs[i].forward && (direction.count == 0 || s.max_codes > direction.max_codes))
+				worst[p] = i;
+			
+			direction.add(s);
+			totals[p].add(s);
+		}
+	}
+	
+	
+	int failures = 0;
+	
+	for(int lossy = 0; lossy <= 1; lossy++)
+	{
+		bool any = false;
+		
+		for(size_t p=0; p < COUNT(g_paths); p++)
+			any = any || (totals[p].count > 0 && g_paths[p].lossy == (lossy != 0));
+		
+		if(!any)
+			continue;
+		
+		fprintf(stderr, "%s%-10s %12s %7s %9s %9s %10s %8s %10s %10s  %s\n",
+					(lossy ? "\nLossy by design, not held to the tolerance:\n" : ""),
+					"path", "samples", "codes", "fwd max", "rev max", "mean", "off %", "max dE", "mean dE", "worst forward configuration");
+		
+		for(size_t p=0; p < COUNT(g_paths); p++)
+		{
+			const Path &path = g_paths[p];
+			const Stats &s = totals[p];
+			
+			if(s.count == 0 || path.lossy != (lossy != 0))
+				continue;
+			
+			const bool failed = Failed(path, forward[p]);
+			
+			// forward-only paths have no reverse column
+			char forward_max[32] = "-", reverse_max[32] = "-";
+			
+			if(forward[p].count > 0)
+				snprintf(forward_max, sizeof(forward_max), "%.3f", forward[p].max_codes);
+			
+			if(reverse[p].count > 0)
+				snprintf(reverse_max, sizeof(reverse_max), "%.3f", reverse[p].max_codes);
+			
+			fprintf(stderr, "%-10s %12lu %7s %9s %9s %10.4f %8.3f %10.4f %10.5f  ",
+						path.name, (unsigned long)s.count, CodeName(path.output),
+						forward_max, reverse_max, s.sum_codes / s.count, 100.0 * s.codes_off / s.count,
+						s.max_delta_e, s.sum_delta_e / s.count);
+			
+			if(forward[p].count > 0)
+			{
+				fprintf(stderr, "%s (%g, %g, %g)", configs[ worst[p] ].name.c_str(),
+							forward[p].worst_input[0], forward[p].worst_input[1], forward[p].worst_input[2]);
+			}
+			
+			fprintf(stderr, "%s\n", (failed ? "  OUT OF TOLERANCE" : ""));
+			
+			if(failed)
+				failures++;
+		}
+	}
+	
+	
+	if(opt.json_path == "-")
+	{
+		WriteJSON(std::cout, configs, results, totals, forward, reverse);
+	}
+	else if( !opt.json_path.empty() )
+	{
+		std::ofstream file(opt.json_path.c_str());
+		
+		WriteJSON(file, configs, results, totals, forward, reverse);
+		
+		if( !file.good() )
+		{
+			fprintf(stderr, "Error writing %s\n", opt.json_path.c_str());
+			return 1;
+		}
+	}
+	
+	
+	if(failures > 0)
+	{
+		fprintf(stderr, "%d paths out of tolerance\n", failures);
+		return 2;
+	}
+	
+	return 0;
+}
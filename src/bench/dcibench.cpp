@@ -0,0 +1,533 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// dcibench.cpp
+//
+// Throughput of the converters in megapixels per second
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter.h"
+#include "DCIconverter_Image.h"
+#include "DCIconverter_SIMD.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+
+typedef struct {
+	const char *name;
+	int width;
+	int height;
+} FrameSize;
+
+static const FrameSize g_sizes[] = {
+	{ "2K", 2048, 1080 },
+	{ "4K", 4096, 2160 },
+	{ "8K", 8192, 4320 }
+};
+
+typedef struct {
+	const char *name;
+	ImageView::ChannelType type;
+	size_t bytes;
+} Format;
+
+static const Format g_formats[] = {
+	{ "8u", ImageView::UInt8, 1 },
+	{ "16u", ImageView::UInt16, 2 },
+	{ "16f", ImageView::Half, 2 },
+	{ "32f", ImageView::Float, 4 }
+};
+
+typedef struct {
+	const char *name;
+	ImageView::Layout layout;
+} Layout;
+
+static const Layout g_layouts[] = {
+	{ "ARGB", ImageView::ARGB },
+	{ "BGRA", ImageView::BGRA }
+};
+
+typedef struct {
+	const char *name;
+	DCIconverterBase::ResponseCurve curve;
+} Curve;
+
+static const Curve g_curves[] = {
+	{ "sRGB", DCIconverterBase::sRGB },
+	{ "Rec709", DCIconverterBase::Rec709 },
+	{ "ProPhoto", DCIconverterBase::ProPhotoRGB },
+	{ "P3", DCIconverterBase::P3 },
+	{ "Linear", DCIconverterBase::Linear },
+	{ "Gamma", DCIconverterBase::Gamma }
+};
+
+typedef struct {
+	const char *name;
+	DCIconverterBase::ChromaticAdaptation adaptation;
+} Adaptation;
+
+static const Adaptation g_adaptations[] = {
+	{ "None", DCIconverterBase::None },
+	{ "D50", DCIconverterBase::D50 },
+	{ "D55", DCIconverterBase::D55 },
+	{ "D60", DCIconverterBase::D60 },
+	{ "D65", DCIconverterBase::D65 },
+	{ "DCI", DCIconverterBase::DCI },
+	{ "Temp", DCIconverterBase::Temp }
+};
+
+#define COUNT(ARRAY) (sizeof(ARRAY) / sizeof(ARRAY[0]))
+
+
+typedef struct {
+	double min_time;
+	bool quick;
+	int threads;
+	DCIconverterBase::Precision precision;
+	std::string only;
+	std::string json_path;
+	std::string baseline_path;
+	double tolerance;
+} Options;
+
+
+static void
+Usage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [options]\n"
+		"\n"
+		"Converts whole frames for every direction, curve, normalize setting,\n"
+		"adaptation, channel type, layout and frame size, single and multi-threaded,\n"
+		"and reports megapixels per second.\n"
+		"\n"
+		"  -q, --quick              sRGB and P3, D65 and Temp adaptation, 2K frames only\n"
+		"  -o, --only TEXT          only run benchmarks whose name contains TEXT\n"
+		"  -t, --min-time SECONDS   time each benchmark for at least this long (0.25)\n"
+		"  -j, --threads N          threads for the multi-threaded runs (all of them)\n"
+		"  -p, --precision NAME     exact, 16 or 12 (exact), the converters' pow\n"
+		"                           approximation, added to the names if not exact\n"
+		"  -w, --json FILE          write results as JSON, - for stdout\n"
+		"  -b, --baseline FILE      compare against results from an earlier --json\n"
+		"  -r, --tolerance PERCENT  slowdown counted as a regression (5)\n"
+		"\n"
+		"With a baseline, the exit code is 2 if anything regressed.\n",
+		program);
+}
+
+
+static bool
+ParseArgs(int argc, char *argv[], Options &opt)
+{
+	opt.min_time = 0.25;
+	opt.quick = false;
+	opt.threads = 0;
+	opt.precision = DCIconverterBase::Exact;
+	opt.tolerance = 5.0;
+	
+	for(int i=1; i < argc; i++)
+	{
+		const std::string arg = argv[i];
+		const char *value = (i + 1 < argc ? argv[i + 1] : NULL);
+		
+		if(arg == "-q" || arg == "--quick")
+		{
+			opt.quick = true;
+			continue;
+		}
+		else if(value == NULL)
+		{
+			return false;
+		}
+		
+		i++;
+		
+		if(arg == "-o" || arg == "--only")
+			opt.only = value;
+		else if(arg == "-t" || arg == "--min-time")
+			opt.min_time = atof(value);
+		else if(arg == "-j" || arg == "--threads")
+			opt.threads = atoi(value);
+		else if(arg == "-p" || arg == "--precision")
+		{
+			const std::string name = value;
+			
+			if(name == "exact")
+				opt.precision = DCIconverterBase::Exact;
+			else if(name == "16")
+				opt.precision = DCIconverterBase::Accurate16;
+			else if(name == "12")
+				opt.precision = DCIconverterBase::Accurate12;
+			else
+				return false;
+		}
+		else if(arg == "-w" || arg == "--json")
+			opt.json_path = value;
+		else if(arg == "-b" || arg == "--baseline")
+			opt.baseline_path = value;
+		else if(arg == "-r" || arg == "--tolerance")
+			opt.tolerance = atof(value);
+		else
+			return false;
+	}
+	
+	return true;
+}
+
+
+typedef struct {
+	std::string name;
+	double mpixels_per_sec;
+} Result;
+
+
+template <typename T>
+static void
+FillImage(std::vector<unsigned char> &buffer, size_t count, float max)
+{
+	// same pseudo-random pixels every run
+	T *pix = (T *)&buffer[0];
+	
+	unsigned int seed = 12345;
+	
+	for(size_t i=0; i < count; i++)
+	{
+		seed = (seed * 1103515245) + 12345;
+		
+		pix[i] = (T)( (float)((seed >> 8) & 0xffff) / 65535.f * max );
+	}
+}
+
+
+static double
+TimeConversion(const ImageConverter &imageConverter, const DCIconverterBase &converter,
+				const ImageView &in, const ImageView &out, double min_time)
+{
+	// one untimed frame to warm up the caches and the pool
+	imageConverter.convert(converter, in, out);
+	
+	int frames = 0;
+	
+	const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	
+	double elapsed = 0.0;
+	
+	do{
+		imageConverter.convert(converter, in, out);
+		
+		frames++;
+		
+		elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		
+	}while(elapsed < min_time);
+	
+	return ((double)in.width * (double)in.height * (double)frames) / elapsed / 1000000.0;
+}
+
+
+static void
+RunBenchmarks(const Options &opt, std::vector<Result> &results)
+{
+	ThreadPool single_pool(0);
+	ThreadPool multi_pool(opt.threads > 0 ? opt.threads - 1 : -1);
+	
+	const ImageConverter single(single_pool);
+	const ImageConverter multi(multi_pool);
+	
+	const size_t num_sizes = (opt.quick ? 1 : COUNT(g_sizes));
+	
+	const std::string precision_name = (opt.precision == DCIconverterBase::Accurate16 ? "/p16" :
+										opt.precision == DCIconverterBase::Accurate12 ? "/p12" : "");
+	
+	for(size_t s=0; s < num_sizes; s++)
+	{
+		const FrameSize &size = g_sizes[s];
+		
+		for(size_t f=0; f < COUNT(g_formats); f++)
+		{
+			const Format &format = g_formats[f];
+			
+			const size_t channels = (size_t)size.width * (size_t)size.height * 4;
+			
+			std::vector<unsigned char> in_buf(channels * format.bytes);
+			std::vector<unsigned char> out_buf(channels * format.bytes);
+			
+			if(format.type == ImageView::UInt8)
+				FillImage<unsigned char>(in_buf, channels, DCIconverterBase::MAX_CHAN8);
+			else if(format.type == ImageView::UInt16)
+				FillImage<unsigned short>(in_buf, channels, DCIconverterBase::MAX_CHAN16);
+			else if(format.type == ImageView::Half)
+				FillImage<half>(in_buf, channels, 1.f);
+			else
+				FillImage<float>(in_buf, channels, 1.f);
+			
+			for(size_t l=0; l < COUNT(g_layouts); l++)
+			{
+				const Layout &layout = g_layouts[l];
+				
+				const ImageView in(&in_buf[0], size.width, size.height, size.width * 4 * format.bytes, layout.layout, format.type);
+				const ImageView out(&out_buf[0], size.width, size.height, size.width * 4 * format.bytes, layout.layout, format.type);
+				
+				for(int forward = 1; forward >= 0; forward--)
+				{
+					for(size_t c=0; c < COUNT(g_curves); c++)
+					{
+						const Curve &curve = g_curves[c];
+						
+						if(opt.quick && curve.curve != DCIconverterBase::sRGB && curve.curve != DCIconverterBase::P3)
+							continue;
+						
+						for(int normalize = 1; normalize >= 0; normalize--)
+						{
+							for(size_t a=0; a < COUNT(g_adaptations); a++)
+							{
+								const Adaptation &adaptation = g_adaptations[a];
+								
+								if(opt.quick && adaptation.adaptation != DCIconverterBase::D65 &&
+												adaptation.adaptation != DCIconverterBase::Temp)
+									continue;
+								
+								const std::string base_name = std::string(forward ? "forward" : "reverse") + "/" +
+																curve.name + "/" + (normalize ? "norm" : "nonorm") + "/" +
+																adaptation.name + "/" + format.name + "/" + layout.name + "/" +
+																size.name + precision_name;
+								
+								const std::string st_name = base_name + "/st";
+								const std::string mt_name = base_name + "/mt";
+								
+								const bool run_st = (st_name.find(opt.only) != std::string::npos);
+								const bool run_mt = (mt_name.find(opt.only) != std::string::npos);
+								
+								if(!run_st && !run_mt)
+									continue;
+								
+								const std::unique_ptr<DCIconverterBase> converter( DCIconverterBase::Create(forward != 0, curve.curve, 2.2f,
+																							DCIconverterBase::sRGB_Rec709, adaptation.adaptation, 5900,
+																							normalize != 0, 2.6f, opt.precision) );
+								
+								if(run_st)
+								{
+									const Result result = { st_name, TimeConversion(single, *converter, in, out, opt.min_time) };
+									
+									fprintf(stderr, "%-50s %10.2f Mpix/s\n", result.name.c_str(), result.mpixels_per_sec);
+									
+									results.push_back(result);
+								}
+								
+								if(run_mt)
+								{
+									const Result result = { mt_name, TimeConversion(multi, *converter, in, out, opt.min_time) };
+									
+									fprintf(stderr, "%-50s %10.2f Mpix/s\n", result.name.c_str(), result.mpixels_per_sec);
+									
+									results.push_back(result);
+								}
+							}
+						}
+					}
+				}
+			}
+		}
+	}
+}
+
+
+static void
+WriteJSON(std::ostream &out, const Options &opt, const std::vector<Result> &results)
+{
+	size_t lanes = 0;
+	DCIgetKernel(&lanes);
+	
+	out << "{\n";
+	out << "  \"hardware_threads\": " << std::thread::hardware_concurrency() << ",\n";
+	out << "  \"threads\": " << (opt.threads > 0 ? opt.threads : (int)std::thread::hardware_concurrency()) << ",\n";
+	out << "  \"simd_lanes\": " << lanes << ",\n";
+	out << "  \"min_time\": " << opt.min_time << ",\n";
+	out << "  \"results\": [\n";
+	
+	for(size_t i=0; i < results.size(); i++)
+	{
+		out << "    { \"name\": \"" << results[i].name << "\", \"mpixels_per_sec\": " << results[i].mpixels_per_sec << " }";
+		out << (i + 1 < results.size() ? ",\n" : "\n");
+	}
+	
+	out << "  ]\n";
+	out << "}\n";
+}
+
+
+static bool
+ReadBaseline(const std::string &path, std::map<std::string, double> &baseline)
+{
+	// Only has to read what WriteJSON writes: one result per line.
+	std::ifstream file(path.c_str());
+	
+	if( !file.good() )
+		return false;
+	
+	std::string line;
+	
+	while( std::getline(file, line) )
+	{
+		const size_t name_key = line.find("\"name\": \"");
+		const size_t speed_key = line.find("\"mpixels_per_sec\": ");
+		
+		if(name_key == std::string::npos || speed_key == std::string::npos)
+			continue;
+		
+		const size_t name_start = name_key + strlen("\"name\": \"");
+		const size_t name_end = line.find('"', name_start);
+		
+		if(name_end == std::string::npos)
+			continue;
+		
+		baseline[ line.substr(name_start, name_end - name_start) ] = atof(line.c_str() + speed_key + strlen("\"mpixels_per_sec\": "));
+	}
+	
+	return true;
+}
+
+
+static int
+CompareBaseline(const std::map<std::string, double> &baseline, const std::vector<Result> &results, double tolerance)
+{
+	int regressions = 0;
+	int compared = 0;
+	
+	double log_sum = 0.0;
+	
+	for(size_t i=0; i < results.size(); i++)
+	{
+		const std::map<std::string, double>::const_iterator old = baseline.find(results[i].name);
+		
+		if(old == baseline.end() || old->second <= 0.0)
+			continue;
+		
+		const double ratio = results[i].mpixels_per_sec / old->second;
+		
+		log_sum += log(ratio);
+		compared++;
+		
+		if(ratio < 1.0 - (tolerance / 100.0))
+		{
+			fprintf(stderr, "REGRESSION %-50s %10.2f -> %10.2f Mpix/s (%+.1f%%)\n",
+						results[i].name.c_str(), old->second, results[i].mpixels_per_sec, (ratio - 1.0) * 100.0);
+			
+			regressions++;
+		}
+	}
+	
+	if(compared > 0)
+	{
+		fprintf(stderr, "%d of %d benchmarks compared regressed by more than %g%%, overall %+.1f%%\n",
+					regressions, compared, tolerance, (exp(log_sum / compared) - 1.0) * 100.0);
+	}
+	else
+		fprintf(stderr, "No benchmarks in common with the baseline\n");
+	
+	return regressions;
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	Options opt;
+	
+	if( !ParseArgs(argc, argv, opt) )
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+	
+	std::map<std::string, double> baseline;
+	
+	if(!opt.baseline_path.empty() && !ReadBaseline(opt.baseline_path, baseline))
+	{
+		fprintf(stderr, "Can't read baseline %s\n", opt.baseline_path.c_str());
+		return 1;
+	}
+	
+	
+	std::vector<Result> results;
+	
+	try
+	{
+		RunBenchmarks(opt, results);
+	}
+	catch(const std::exception &e)
+	{
+		fprintf(stderr, "dcibench: %s\n", e.what());
+		return 1;
+	}
+	
+	
+	if(opt.json_path == "-")
+	{
+		WriteJSON(std::cout, opt, results);
+	}
+	else if( !opt.json_path.empty() )
+	{
+		std::ofstream file(opt.json_path.c_str());
+		
+		WriteJSON(file, opt, results);
+		
+		if( !file.good() )
+		{
+			fprintf(stderr, "Error writing %s\n", opt.json_path.c_str());
+			return 1;
+		}
+	}
+	
+	
+	if( !opt.baseline_path.empty() )
+	{
+		if(CompareBaseline(baseline, results, opt.tolerance) > 0)
+			return 2;
+	}
+	
+	return 0;
+}
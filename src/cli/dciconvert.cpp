@@ -0,0 +1,1100 @@
+///////////////////////////////////////////////////////////////////////////
+//
+// Copyright (c) 2013, Brendan Bolles
+// 
+// All rights reserved.
+// 
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+// *	   Redistributions of source code must retain the above copyright
+// notice, this list of conditions and the following disclaimer.
+// *	   Redistributions in binary form must reproduce the above
+// copyright notice, this list of conditions and the following disclaimer
+// in the documentation and/or other materials provided with the
+// distribution.
+// 
+// THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+// "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+// LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+// A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+// OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+// SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+// LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+// DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+// THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+// (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+// OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+//
+///////////////////////////////////////////////////////////////////////////
+
+// ------------------------------------------------------------------------
+//
+// dciconvert.cpp
+//
+// Command line DCI conversion of OpenEXR frames and sequences
+//
+// ------------------------------------------------------------------------
+
+
+#include "DCIconverter.h"
+#include "DCIconverter_Chain.h"
+#include "DCIconverter_Image.h"
+#include "DCIconverter_Packed.h"
+#include "DCIconverter_Sequence.h"
+#include "DCIconverter_Stats.h"
+#include "DCIconverter_Trace.h"
+
+#include "IexBaseExc.h"
+
+#include <ImfInputFile.h>
+#include <ImfOutputFile.h>
+#include <ImfChannelList.h>
+#include <ImfFrameBuffer.h>
+#include <ImfHeader.h>
+#include <ImfThreading.h>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifndef _WIN32
+	#include <sys/stat.h>
+#endif
+
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+
+typedef enum {
+	OUTPUT_EXR_HALF,
+	OUTPUT_EXR_FLOAT,
+	OUTPUT_RAW12,
+	OUTPUT_RAW16,
+	OUTPUT_DPX
+} OutputFormat;
+
+typedef enum {
+	DISPLAY_NONE,
+	DISPLAY_SRGB,
+	DISPLAY_P3
+} Display;
+
+typedef struct {
+	bool forward;
+	DCIconverterBase::ResponseCurve curve;
+	float gamma;
+	DCIconverterBase::ColorSpace color;
+	DCIconverterBase::ChromaticAdaptation adaptation;
+	int temperature;
+	bool normalize;
+	float xyz_gamma;
+	DCIconverterBase::Precision precision;
+	Display display;
+	
+	OutputFormat format;
+	int first_frame;
+	int last_frame;
+	bool sequence;
+	int threads;
+	int readers;
+	int writers;
+	bool verbose;
+	bool stats;
+	std::string metrics; // Prometheus text file, empty for none
+	std::string trace; // Chrome trace JSON, empty for none
+	
+	bool mapped; // DPX or raw input, converted in place in memory-mapped files
+	int raw_width;
+	int raw_height;
+	int raw_max;
+	
+	std::string input;
+	std::string output;
+} Options;
+
+
+static void
+Usage(const char *program)
+{
+	fprintf(stderr,
+		"usage: %s [options] input.exr output.exr\n"
+		"       %s [options] -f first-last input.####.exr output.####.exr\n"
+		"\n"
+		"Sequences use #### (one # per digit) or printf style %%04d for the frame number.\n"
+		"\n"
+		"Conversion (defaults match the After Effects plug-in):\n"
+		"  -r, --reverse            XYZ to RGB instead of RGB to XYZ\n"
+		"  -c, --curve NAME         sRGB, Rec709, ProPhoto, P3, Linear or Gamma (sRGB)\n"
+		"  -g, --gamma VALUE        gamma for the Gamma curve (2.2)\n"
+		"  -s, --colorspace NAME    sRGB, ProPhoto or P3 (sRGB)\n"
+		"  -a, --adaptation NAME    None, D50, D55, D60, D65, DCI or Temp (Temp)\n"
+		"  -t, --temperature K      white for Temp adaptation (5900)\n"
+		"  -n, --no-normalize       don't normalize to 48 cd/m^2 in a 52.37 cd/m^2 range\n"
+		"  -x, --xyz-gamma VALUE    X'Y'Z' gamma (2.6)\n"
+		"  -p, --precision NAME     exact, 16 or 12 (exact), how closely curves are\n"
+		"                           computed for float input: 16 and 12 are within half\n"
+		"                           a code of exact at that depth, and faster\n"
+		"  -d, --display NAME       none, sRGB or P3 (none), convert the X'Y'Z' back\n"
+		"                           to RGB for that display, as a preview of the DCP,\n"
+		"                           fused with the conversion into one pass\n"
+		"\n"
+		"Output:\n"
+		"  -o, --output-format FMT  half (EXR, the default), float (EXR), raw12, raw16 or dpx\n"
+		"                           raw12 is three planes (X, Y, Z or R, G, B) of\n"
+		"                           12-bit codes in little-endian 16-bit words, raw16\n"
+		"                           the same with 16-bit codes, dpx the input's DPX format\n"
+		"                           with user-defined transfer and colorimetry\n"
+		"\n"
+		"DPX and raw input (.dpx and .raw files) are memory-mapped and converted\n"
+		"straight into memory-mapped raw or DPX output.  DPX input has to be RGB,\n"
+		"10-bit filled or 16-bit, and raw input is raw16 style planes:\n"
+		"  -z, --raw-size WxH       size of raw input frames\n"
+		"  -m, --raw-max CODE       largest code value in raw input (65535)\n"
+		"\n"
+		"Processing:\n"
+		"  -f, --frames FIRST-LAST  frame range for sequences\n"
+		"  -j, --threads N          threads for conversion and EXR decode/encode\n"
+		"  -R, --readers N          frames read at the same time (2)\n"
+		"  -W, --writers N          frames written at the same time (2)\n"
+		"  -S, --stats              print how busy each stage was, to see whether\n"
+		"                           disk or conversion is holding things up, and\n"
+		"                           where conversion time went\n"
+		"  -M, --metrics FILE       write conversion counters to FILE for a Prometheus\n"
+		"                           textfile collector\n"
+		"  -T, --trace FILE         write a timeline of every thread to FILE, Chrome\n"
+		"                           trace JSON for chrome://tracing or Perfetto\n"
+		"  -v, --verbose            print each frame\n",
+		program, program);
+}
+
+
+static bool
+Match(const char *arg, const char *short_name, const char *long_name)
+{
+	return (strcmp(arg, short_name) == 0 || strcmp(arg, long_name) == 0);
+}
+
+
+static bool
+ParseName(const char *value, const char *names[], int count, int &index)
+{
+	for(int i=0; i < count; i++)
+	{
+		if(strcasecmp(value, names[i]) == 0)
+		{
+			index = i;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+
+static bool
+HasExtension(const std::string &path, const char *extension)
+{
+	const size_t length = strlen(extension);
+	
+	if(path.size() < length)
+		return false;
+	
+	for(size_t i=0; i < length; i++)
+	{
+		if(tolower(path[path.size() - length + i]) != extension[i])
+			return false;
+	}
+	
+	return true;
+}
+
+
+// Where the frame number goes in a sequence path: one run of #s, as in
+// frame.####.exr, or one %d or %0Nd, as in frame.%04d.exr.  Anything else,
+// including a second placeholder or any other % conversion, isn't one.
+static bool
+FramePlaceholder(const std::string &pattern, size_t &start, size_t &length, int &digits)
+{
+	const size_t hash = pattern.find('#');
+	const size_t percent = pattern.find('%');
+	
+	if(hash != std::string::npos && percent == std::string::npos)
+	{
+		length = 0;
+		
+		while(hash + length < pattern.size() && pattern[hash + length] == '#')
+			length++;
+		
+		start = hash;
+		digits = (int)length;
+		
+		return (pattern.find('#', hash + length) == std::string::npos);
+	}
+	else if(percent != std::string::npos && hash == std::string::npos)
+	{
+		size_t end = percent + 1;
+		
+		int width = 0;
+		
+		if(end < pattern.size() && pattern[end] == '0')
+		{
+			end++;
+			
+			while(end < pattern.size() && isdigit((unsigned char)pattern[end]) && width < 100)
+				width = (width * 10) + (pattern[end++] - '0');
+			
+			if(width == 0)
+				return false;
+		}
+		
+		if(end >= pattern.size() || pattern[end] != 'd')
+			return false;
+		
+		start = percent;
+		length = end + 1 - percent;
+		digits = width;
+		
+		return (pattern.find('%', end) == std::string::npos);
+	}
+	
+	return false;
+}
+
+
+static bool
+ParseArgs(int argc, char *argv[], Options &opt)
+{
+	opt.forward = true;
+	opt.curve = DCIconverterBase::sRGB;
+	opt.gamma = 2.2f;
+	opt.color = DCIconverterBase::sRGB_Rec709;
+	opt.adaptation = DCIconverterBase::Temp;
+	opt.temperature = 5900;
+	opt.normalize = true;
+	opt.xyz_gamma = 2.6f;
+	opt.precision = DCIconverterBase::Exact;
+	opt.display = DISPLAY_NONE;
+	
+	opt.format = OUTPUT_EXR_HALF;
+	opt.first_frame = opt.last_frame = 0;
+	opt.sequence = false;
+	opt.threads = 0;
+	opt.readers = 2;
+	opt.writers = 2;
+	opt.verbose = false;
+	opt.stats = false;
+	
+	opt.mapped = false;
+	opt.raw_width = opt.raw_height = 0;
+	opt.raw_max = 65535;
+	
+	std::vector<std::string> files;
+	
+	for(int i=1; i < argc; i++)
+	{
+		const char *arg = argv[i];
+		const char *value = (i + 1 < argc ? argv[i + 1] : NULL);
+		
+		if( Match(arg, "-r", "--reverse") )
+		{
+			opt.forward = false;
+		}
+		else if( Match(arg, "-n", "--no-normalize") )
+		{
+			opt.normalize = false;
+		}
+		else if( Match(arg, "-v", "--verbose") )
+		{
+			opt.verbose = true;
+		}
+		else if( Match(arg, "-S", "--stats") )
+		{
+			opt.stats = true;
+		}
+		else if( Match(arg, "-h", "--help") )
+		{
+			return false;
+		}
+		else if(arg[0] == '-' && arg[1] != '\0')
+		{
+			if(value == NULL)
+			{
+				fprintf(stderr, "%s needs a value\n", arg);
+				return false;
+			}
+			
+			i++;
+			
+			int index = 0;
+			
+			if( Match(arg, "-c", "--curve") )
+			{
+				const char *names[] = { "sRGB", "Rec709", "ProPhoto", "P3", "Linear", "Gamma" };
+				const DCIconverterBase::ResponseCurve values[] = {	DCIconverterBase::sRGB, DCIconverterBase::Rec709,
+																	DCIconverterBase::ProPhotoRGB, DCIconverterBase::P3,
+																	DCIconverterBase::Linear, DCIconverterBase::Gamma };
+				if( !ParseName(value, names, 6, index) )
+				{
+					fprintf(stderr, "Unknown curve: %s\n", value);
+					return false;
+				}
+				
+				opt.curve = values[index];
+			}
+			else if( Match(arg, "-s", "--colorspace") )
+			{
+				const char *names[] = { "sRGB", "ProPhoto", "P3" };
+				const DCIconverterBase::ColorSpace values[] = {	DCIconverterBase::sRGB_Rec709,
+																DCIconverterBase::ProPhotoRGB_ROMM,
+																DCIconverterBase::P3_RGB };
+				if( !ParseName(value, names, 3, index) )
+				{
+					fprintf(stderr, "Unknown color space: %s\n", value);
+					return false;
+				}
+				
+				opt.color = values[index];
+			}
+			else if( Match(arg, "-a", "--adaptation") )
+			{
+				const char *names[] = { "None", "D50", "D55", "D60", "D65", "DCI", "Temp" };
+				const DCIconverterBase::ChromaticAdaptation values[] = {	DCIconverterBase::None, DCIconverterBase::D50,
+																			DCIconverterBase::D55, DCIconverterBase::D60,
+																			DCIconverterBase::D65, DCIconverterBase::DCI,
+																			DCIconverterBase::Temp };
+				if( !ParseName(value, names, 7, index) )
+				{
+					fprintf(stderr, "Unknown adaptation: %s\n", value);
+					return false;
+				}
+				
+				opt.adaptation = values[index];
+			}
+			else if( Match(arg, "-p", "--precision") )
+			{
+				const char *names[] = { "exact", "16", "12" };
+				const DCIconverterBase::Precision values[] = {	DCIconverterBase::Exact,
+																DCIconverterBase::Accurate16,
+																DCIconverterBase::Accurate12 };
+				if( !ParseName(value, names, 3, index) )
+				{
+					fprintf(stderr, "Unknown precision: %s\n", value);
+					return false;
+				}
+				
+				opt.precision = values[index];
+			}
+			else if( Match(arg, "-d", "--display") )
+			{
+				const char *names[] = { "none", "sRGB", "P3" };
+				const Display values[] = { DISPLAY_NONE, DISPLAY_SRGB, DISPLAY_P3 };
+				
+				if( !ParseName(value, names, 3, index) )
+				{
+					fprintf(stderr, "Unknown display: %s\n", value);
+					return false;
+				}
+				
+				opt.display = values[index];
+			}
+			else if( Match(arg, "-o", "--output-format") )
+			{
+				const char *names[] = { "half", "float", "raw12", "raw16", "dpx" };
+				const OutputFormat values[] = { OUTPUT_EXR_HALF, OUTPUT_EXR_FLOAT, OUTPUT_RAW12, OUTPUT_RAW16, OUTPUT_DPX };
+				
+				if( !ParseName(value, names, 5, index) )
+				{
+					fprintf(stderr, "Unknown output format: %s\n", value);
+					return false;
+				}
+				
+				opt.format = values[index];
+			}
+			else if( Match(arg, "-g", "--gamma") )
+			{
+				opt.gamma = atof(value);
+			}
+			else if( Match(arg, "-t", "--temperature") )
+			{
+				opt.temperature = atoi(value);
+			}
+			else if( Match(arg, "-x", "--xyz-gamma") )
+			{
+				opt.xyz_gamma = atof(value);
+			}
+			else if( Match(arg, "-j", "--threads") )
+			{
+				opt.threads = atoi(value);
+			}
+			else if( Match(arg, "-z", "--raw-size") )
+			{
+				if(sscanf(value, "%dx%d", &opt.raw_width, &opt.raw_height) != 2 ||
+					opt.raw_width < 1 || opt.raw_height < 1)
+				{
+					fprintf(stderr, "Raw size should look like 4096x2160\n");
+					return false;
+				}
+			}
+			else if( Match(arg, "-m", "--raw-max") )
+			{
+				opt.raw_max = atoi(value);
+			}
+			else if( Match(arg, "-R", "--readers") )
+			{
+				opt.readers = atoi(value);
+			}
+			else if( Match(arg, "-W", "--writers") )
+			{
+				opt.writers = atoi(value);
+			}
+			else if( Match(arg, "-M", "--metrics") )
+			{
+				opt.metrics = value;
+			}
+			else if( Match(arg, "-T", "--trace") )
+			{
+				opt.trace = value;
+			}
+			else if( Match(arg, "-f", "--frames") )
+			{
+				if(sscanf(value, "%d-%d", &opt.first_frame, &opt.last_frame) != 2 ||
+					opt.last_frame < opt.first_frame)
+				{
+					fprintf(stderr, "Frames should look like 1-100\n");
+					return false;
+				}
+				
+				opt.sequence = true;
+			}
+			else
+			{
+				fprintf(stderr, "Unknown option: %s\n", arg);
+				return false;
+			}
+		}
+		else
+		{
+			files.push_back(arg);
+		}
+	}
+	
+	if(files.size() != 2)
+		return false;
+	
+	if(opt.gamma <= 0.f || opt.xyz_gamma <= 0.f)
+	{
+		fprintf(stderr, "Gammas have to be positive\n");
+		return false;
+	}
+	
+	if(opt.display != DISPLAY_NONE && !opt.forward)
+	{
+		fprintf(stderr, "--display previews RGB to XYZ conversions, it can't be used with --reverse\n");
+		return false;
+	}
+	
+	if(opt.readers < 1 || opt.writers < 1)
+	{
+		fprintf(stderr, "Need at least one reader and one writer\n");
+		return false;
+	}
+	
+	opt.input = files[0];
+	opt.output = files[1];
+	
+	if(opt.sequence)
+	{
+		size_t start, length;
+		int digits;
+		
+		// otherwise every frame would read and write the same file
+		if( !FramePlaceholder(opt.input, start, length, digits) ||
+			!FramePlaceholder(opt.output, start, length, digits) )
+		{
+			fprintf(stderr, "With --frames, input and output paths each need one frame number, like #### or %%04d\n");
+			return false;
+		}
+	}
+	
+	
+	const bool dpx_input = HasExtension(opt.input, ".dpx");
+	const bool raw_input = HasExtension(opt.input, ".raw");
+	
+	opt.mapped = (dpx_input || raw_input);
+	
+	if(opt.mapped && (opt.format == OUTPUT_EXR_HALF || opt.format == OUTPUT_EXR_FLOAT))
+	{
+		fprintf(stderr, "DPX and raw input can only be written as raw12, raw16 or dpx\n");
+		return false;
+	}
+	
+	if(!opt.mapped && (opt.format == OUTPUT_RAW16 || opt.format == OUTPUT_DPX))
+	{
+		fprintf(stderr, "raw16 and dpx output need DPX or raw input\n");
+		return false;
+	}
+	
+	if(opt.format == OUTPUT_DPX && !dpx_input)
+	{
+		fprintf(stderr, "dpx output needs DPX input\n");
+		return false;
+	}
+	
+	if(raw_input && (opt.raw_width < 1 || opt.raw_max < 1 || opt.raw_max > 65535))
+	{
+		fprintf(stderr, "Raw input needs --raw-size, and --raw-max has to be 1-65535\n");
+		return false;
+	}
+	
+	// mapped output is truncated before the input is read
+	if(opt.mapped && opt.input == opt.output)
+	{
+		fprintf(stderr, "DPX and raw input can't be converted in place, the output has to be another file\n");
+		return false;
+	}
+	
+	return true;
+}
+
+
+// Two names for one file, as far as we can tell.  A file that isn't there
+// yet can't be the input.
+static bool
+SameFile(const std::string &a, const std::string &b)
+{
+	if(a == b)
+		return true;
+	
+#ifndef _WIN32
+	struct stat a_stat, b_stat;
+	
+	if(stat(a.c_str(), &a_stat) == 0 && stat(b.c_str(), &b_stat) == 0)
+		return (a_stat.st_dev == b_stat.st_dev && a_stat.st_ino == b_stat.st_ino);
+#endif
+	
+	return false;
+}
+
+
+// Output DPX headers are the input's with the transfer and colorimetric
+// characteristics of the first image element (SMPTE 268M, 801 and 802) set
+// to user-defined, since the pixels no longer follow the input's.
+static void
+MarkDPXUserDefined(unsigned char *header, size_t header_size)
+{
+	if(header_size > 802)
+	{
+		header[801] = 0;
+		header[802] = 0;
+	}
+}
+
+
+static std::string
+FramePath(const std::string &pattern, int frame)
+{
+	size_t start = 0, length = 0;
+	int digits = 0;
+	
+	if( !FramePlaceholder(pattern, start, length, digits) )
+		return pattern;
+	
+	char num[128];
+	snprintf(num, sizeof(num), "%0*d", digits, frame);
+	
+	return pattern.substr(0, start) + num + pattern.substr(start + length);
+}
+
+
+template <typename T> static inline Imf::PixelType PixelTypeOf();
+template <> inline Imf::PixelType PixelTypeOf<float>() { return Imf::FLOAT; }
+template <> inline Imf::PixelType PixelTypeOf<half>() { return Imf::HALF; }
+
+
+static bool
+HasHalfRGB(const Imf::Header &header)
+{
+	// channels that aren't there will be filled, so they don't count
+	const char *names[] = { "R", "G", "B" };
+	
+	for(int i=0; i < 3; i++)
+	{
+		const Imf::Channel *channel = header.channels().findChannel(names[i]);
+		
+		if(channel != NULL && channel->type != Imf::HALF)
+			return false;
+	}
+	
+	return true;
+}
+
+
+template <typename T>
+static void
+ReadPixels(Imf::InputFile &file, std::vector<T> &rgba, int &width, int &height)
+{
+	const Imath::Box2i &dw = file.header().dataWindow();
+	
+	width = dw.max.x - dw.min.x + 1;
+	height = dw.max.y - dw.min.y + 1;
+	
+	rgba.resize((size_t)width * (size_t)height * 4);
+	
+	
+	const Imf::PixelType type = PixelTypeOf<T>();
+	
+	const size_t xstride = sizeof(T) * 4;
+	const size_t ystride = xstride * width;
+	
+	char *origin = (char *)&rgba[0] - ((ptrdiff_t)dw.min.x * (ptrdiff_t)xstride) - ((ptrdiff_t)dw.min.y * (ptrdiff_t)ystride);
+	
+	Imf::FrameBuffer frameBuffer;
+	
+	// channels that aren't in the file get filled, alpha with 1
+	frameBuffer.insert("R", Imf::Slice(type, origin + (sizeof(T) * 0), xstride, ystride, 1, 1, 0.0));
+	frameBuffer.insert("G", Imf::Slice(type, origin + (sizeof(T) * 1), xstride, ystride, 1, 1, 0.0));
+	frameBuffer.insert("B", Imf::Slice(type, origin + (sizeof(T) * 2), xstride, ystride, 1, 1, 0.0));
+	frameBuffer.insert("A", Imf::Slice(type, origin + (sizeof(T) * 3), xstride, ystride, 1, 1, 1.0));
+	
+	file.setFrameBuffer(frameBuffer);
+	file.readPixels(dw.min.y, dw.max.y);
+}
+
+
+template <typename T>
+static void
+WriteEXR(const std::string &path, const Imf::Header &inHeader, const std::vector<T> &rgba, bool half)
+{
+	// keep the windows, compression and attributes, but only write RGBA
+	Imf::Header header = inHeader;
+	
+	const bool has_alpha = (header.channels().findChannel("A") != NULL);
+	
+	const Imf::PixelType type = (half ? Imf::HALF : Imf::FLOAT);
+	
+	Imf::ChannelList channels;
+	
+	channels.insert("R", Imf::Channel(type));
+	channels.insert("G", Imf::Channel(type));
+	channels.insert("B", Imf::Channel(type));
+	
+	if(has_alpha)
+		channels.insert("A", Imf::Channel(type));
+	
+	header.channels() = channels;
+	
+	
+	const Imath::Box2i &dw = header.dataWindow();
+	
+	const int width = dw.max.x - dw.min.x + 1;
+	
+	const Imf::PixelType buffer_type = PixelTypeOf<T>();
+	
+	const size_t xstride = sizeof(T) * 4;
+	const size_t ystride = xstride * width;
+	
+	char *origin = (char *)&rgba[0] - ((ptrdiff_t)dw.min.x * (ptrdiff_t)xstride) - ((ptrdiff_t)dw.min.y * (ptrdiff_t)ystride);
+	
+	Imf::FrameBuffer frameBuffer;
+	
+	frameBuffer.insert("R", Imf::Slice(buffer_type, origin + (sizeof(T) * 0), xstride, ystride));
+	frameBuffer.insert("G", Imf::Slice(buffer_type, origin + (sizeof(T) * 1), xstride, ystride));
+	frameBuffer.insert("B", Imf::Slice(buffer_type, origin + (sizeof(T) * 2), xstride, ystride));
+	
+	if(has_alpha)
+		frameBuffer.insert("A", Imf::Slice(buffer_type, origin + (sizeof(T) * 3), xstride, ystride));
+	
+	Imf::OutputFile file(path.c_str(), header);
+	
+	file.setFrameBuffer(frameBuffer);
+	file.writePixels(dw.max.y - dw.min.y + 1);
+}
+
+
+static void
+ConvertRaw12(const std::vector<float> &rgba, int width, int height, std::vector<unsigned short> &planes,
+				const DCIconverterBase &converter, ThreadPool &pool)
+{
+	// Three planes of codes, converted a row at a time.  Going forward the
+	// converter rounds straight to DCDM codes, otherwise the converted RGB
+	// is quantized the same way.
+	const size_t plane_size = (size_t)width * (size_t)height;
+	
+	planes.resize(plane_size * 3);
+	
+	const ForwardDCIconverter *dcdm = dynamic_cast<const ForwardDCIconverter *>(&converter);
+	
+	pool.parallelFor(height, [&](size_t y)
+	{
+		const ConverterTrace::Span span("row", "raw12", y);
+		
+		const float *in = &rgba[y * width * 4];
+		
+		std::vector<unsigned short> codes((size_t)width * 3);
+		
+		if(dcdm != NULL)
+		{
+			dcdm->convertSpanDCDM(in, &codes[0], width, 4, 3);
+		}
+		else
+		{
+			std::vector<float> rgb((size_t)width * 3);
+			
+			converter.convertSpan(in, &rgb[0], width, 4, 3);
+			
+			for(size_t i=0; i < rgb.size(); i++)
+			{
+				const float val = (rgb[i] >= 1.f ? 1.f : rgb[i] <= 0.f ? 0.f : rgb[i]);
+				
+				codes[i] = (val * 4095.f) + 0.5f;
+			}
+		}
+		
+		for(int x=0; x < width; x++)
+		{
+			for(int c=0; c < 3; c++)
+			{
+				const unsigned short code = codes[(x * 3) + c];
+				
+				// little-endian whatever the machine
+				unsigned char *out = (unsigned char *)&planes[(c * plane_size) + (y * width) + x];
+				
+				out[0] = (code & 0xff);
+				out[1] = (code >> 8);
+			}
+		}
+	});
+}
+
+
+static void
+WriteRaw12(const std::string &path, const std::vector<unsigned short> &planes)
+{
+	std::ofstream file(path.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	
+	if( !file.good() )
+		throw Iex::IoExc("Can't write " + path);
+	
+	file.write((const char *)&planes[0], planes.size() * sizeof(unsigned short));
+	
+	if( !file.good() )
+		throw Iex::IoExc("Error writing " + path);
+}
+
+
+// Buffers for one frame, reused from frame to frame
+class EXRFrame : public SequenceFrame
+{
+  public:
+	EXRFrame() : is_half(false), width(0), height(0) {}
+	
+	std::string in_path;
+	std::string out_path;
+	
+	Imf::Header header;
+	std::vector<float> rgba;
+	std::vector<half> rgba_half; // used instead when the file and output are both half
+	bool is_half;
+	int width;
+	int height;
+	
+	std::vector<unsigned short> planes; // raw12 output
+};
+
+
+static SequenceStats
+ConvertEXR(const Options &opt, const DCIconverterBase &converter, ThreadPool &pool)
+{
+	const ImageConverter imageConverter(pool);
+	
+	const int first = (opt.sequence ? opt.first_frame : 0);
+	const int last = (opt.sequence ? opt.last_frame : 0);
+	
+	
+	// Readers, this thread converting and writers all at once, so the disk
+	// is busy while the CPUs are.
+	const SequenceProcessor processor(opt.readers, opt.writers);
+	
+	const SequenceProcessor::Stage read = [&opt, first](SequenceFrame &sequenceFrame)
+	{
+		EXRFrame &frame = static_cast<EXRFrame &>(sequenceFrame);
+		
+		const int number = first + (int)frame.number;
+		
+		frame.in_path = (opt.sequence ? FramePath(opt.input, number) : opt.input);
+		frame.out_path = (opt.sequence ? FramePath(opt.output, number) : opt.output);
+		
+		Imf::InputFile file( frame.in_path.c_str() );
+		
+		frame.header = file.header();
+		
+		// Half sources going to half output stay half, so the converter
+		// can use its half tables and nothing gets rounded twice.
+		frame.is_half = (opt.format == OUTPUT_EXR_HALF && HasHalfRGB(frame.header));
+		
+		if(frame.is_half)
+		{
+			ReadPixels(file, frame.rgba_half, frame.width, frame.height);
+			
+			frame.image = ImageView(&frame.rgba_half[0], frame.width, frame.height, frame.width * sizeof(half) * 4,
+									ImageView::RGBA, ImageView::Half);
+		}
+		else
+		{
+			ReadPixels(file, frame.rgba, frame.width, frame.height);
+			
+			frame.image = ImageView(&frame.rgba[0], frame.width, frame.height, frame.width * sizeof(float) * 4,
+									ImageView::RGBA, ImageView::Float);
+		}
+	};
+	
+	const SequenceProcessor::Stage convert = [&](SequenceFrame &sequenceFrame)
+	{
+		EXRFrame &frame = static_cast<EXRFrame &>(sequenceFrame);
+		
+		if(opt.format == OUTPUT_RAW12)
+			ConvertRaw12(frame.rgba, frame.width, frame.height, frame.planes, converter, pool);
+		else
+			imageConverter.convert(converter, frame.image);
+	};
+	
+	const SequenceProcessor::Stage write = [&opt](SequenceFrame &sequenceFrame)
+	{
+		EXRFrame &frame = static_cast<EXRFrame &>(sequenceFrame);
+		
+		if(opt.format == OUTPUT_RAW12)
+			WriteRaw12(frame.out_path, frame.planes);
+		else if(frame.is_half)
+			WriteEXR(frame.out_path, frame.header, frame.rgba_half, true);
+		else
+			WriteEXR(frame.out_path, frame.header, frame.rgba, opt.format == OUTPUT_EXR_HALF);
+		
+		if(opt.verbose)
+			printf("%s -> %s\n", frame.in_path.c_str(), frame.out_path.c_str());
+	};
+	
+	return processor.run(last - first + 1, read, convert, write,
+							[] { return new EXRFrame; });
+}
+
+
+// Input and output files mapped into memory
+class MappedFrame : public SequenceFrame
+{
+  public:
+	std::string in_path;
+	std::string out_path;
+	
+	std::unique_ptr<MappedFile> in;
+	std::unique_ptr<MappedFile> out;
+	
+	PackedLayout in_layout;
+	PackedLayout out_layout;
+};
+
+
+static SequenceStats
+ConvertMapped(const Options &opt, const DCIconverterBase &converter, ThreadPool &pool)
+{
+	// No pixel buffers at all: the read stage maps the input and pulls it in
+	// from disk, the convert stage maps the output and converts straight
+	// from one mapping to the other, and the write stage lets both go (the
+	// system writes the output pages back).
+	const PackedConverter packedConverter(pool);
+	
+	const int first = (opt.sequence ? opt.first_frame : 0);
+	const int last = (opt.sequence ? opt.last_frame : 0);
+	
+	const SequenceProcessor processor(opt.readers, opt.writers);
+	
+	const SequenceProcessor::Stage read = [&opt, first](SequenceFrame &sequenceFrame)
+	{
+		MappedFrame &frame = static_cast<MappedFrame &>(sequenceFrame);
+		
+		const int number = first + (int)frame.number;
+		
+		frame.in_path = (opt.sequence ? FramePath(opt.input, number) : opt.input);
+		frame.out_path = (opt.sequence ? FramePath(opt.output, number) : opt.output);
+		
+		if( SameFile(frame.in_path, frame.out_path) )
+			throw Iex::ArgExc(frame.out_path + " is the input, it would be truncated before it was read.");
+		
+		frame.in.reset( new MappedFile(frame.in_path) );
+		
+		if( HasExtension(frame.in_path, ".dpx") )
+		{
+			frame.in_layout = ReadDPXLayout(frame.in->data(), frame.in->size());
+		}
+		else
+		{
+			frame.in_layout = PackedLayout::Planar(opt.raw_width, opt.raw_height, opt.raw_max);
+			
+			if(frame.in->size() < frame.in_layout.dataSize())
+				throw Iex::InputExc(frame.in_path + " is smaller than --raw-size says.");
+		}
+		
+		frame.in->prefetch();
+	};
+	
+	const SequenceProcessor::Stage convert = [&](SequenceFrame &sequenceFrame)
+	{
+		MappedFrame &frame = static_cast<MappedFrame &>(sequenceFrame);
+		
+		const int width = frame.in_layout.width;
+		const int height = frame.in_layout.height;
+		
+		if(opt.format == OUTPUT_DPX)
+		{
+			// same header and packing as the input
+			frame.out_layout = frame.in_layout;
+			frame.out.reset( new MappedFile(frame.out_path, frame.in->size()) );
+			
+			memcpy(frame.out->data(), frame.in->data(), frame.in_layout.offset);
+			
+			MarkDPXUserDefined(frame.out->data(), frame.in_layout.offset);
+		}
+		else
+		{
+			frame.out_layout = PackedLayout::Planar(width, height, (opt.format == OUTPUT_RAW12 ? 4095 : 65535));
+			frame.out.reset( new MappedFile(frame.out_path, frame.out_layout.dataSize()) );
+		}
+		
+		packedConverter.convert(converter, frame.in->data(), frame.in_layout, frame.out->data(), frame.out_layout);
+	};
+	
+	const SequenceProcessor::Stage write = [&opt](SequenceFrame &sequenceFrame)
+	{
+		MappedFrame &frame = static_cast<MappedFrame &>(sequenceFrame);
+		
+		frame.out.reset();
+		frame.in.reset();
+		
+		if(opt.verbose)
+			printf("%s -> %s\n", frame.in_path.c_str(), frame.out_path.c_str());
+	};
+	
+	return processor.run(last - first + 1, read, convert, write,
+							[] { return new MappedFrame; });
+}
+
+
+static void
+PrintConverterStats(FILE *file, const ConverterStats &stats)
+{
+	double total = 0.0;
+	
+	for(int s=0; s < STATS_STAGES; s++)
+		total += stats.seconds[s];
+	
+	for(int s=0; s < STATS_STAGES; s++)
+	{
+		if(stats.calls[s] > 0)
+		{
+			fprintf(file, "%-8s %9.2fs %5.1f%% of conversion %10llu spans\n",
+						ConverterInstruments::StageName((StatsStage)s), stats.seconds[s],
+						(total > 0.0 ? stats.seconds[s] * 100.0 / total : 0.0), stats.calls[s]);
+		}
+	}
+	
+	const double channels = stats.pixels * 3.0;
+	
+	// a channel can go through more than one power, so negatives aren't a share of anything
+	fprintf(file, "%llu pixels, %llu powers of a negative value, %llu output channels clipped (%.3f%%)\n",
+				stats.pixels, stats.negative,
+				stats.clipped, (channels > 0.0 ? stats.clipped * 100.0 / channels : 0.0));
+}
+
+
+int
+main(int argc, char *argv[])
+{
+	Options opt;
+	
+	if( !ParseArgs(argc, argv, opt) )
+	{
+		Usage(argv[0]);
+		return 1;
+	}
+	
+	if( !opt.trace.empty() )
+		ConverterTrace::Start();
+	
+	int result = 0;
+	
+	try
+	{
+		if(opt.threads > 0)
+			Imf::setGlobalThreadCount(opt.threads);
+		else
+			Imf::setGlobalThreadCount( std::thread::hardware_concurrency() );
+		
+		ThreadPool pool(opt.threads > 0 ? opt.threads - 1 : 0);
+		ThreadPool &convert_pool = (opt.threads > 0 ? pool : ThreadPool::Global());
+		
+		const std::unique_ptr<DCIconverterBase> converter( DCIconverterBase::Create(opt.forward, opt.curve, opt.gamma,
+																					opt.color, opt.adaptation, opt.temperature,
+																					opt.normalize, opt.xyz_gamma, opt.precision) );
+		
+		// The display side undoes the same X'Y'Z' gamma and normalization,
+		// so the chain cancels them and never goes through X'Y'Z' at all.
+		std::unique_ptr<DCIconverterBase> display;
+		std::unique_ptr<DCIconverterChain> preview;
+		
+		if(opt.display != DISPLAY_NONE)
+		{
+			const bool p3 = (opt.display == DISPLAY_P3);
+			
+			display.reset( DCIconverterBase::Create(false, (p3 ? DCIconverterBase::P3 : DCIconverterBase::sRGB), 2.6f,
+													(p3 ? DCIconverterBase::P3_RGB : DCIconverterBase::sRGB_Rec709),
+													(p3 ? DCIconverterBase::DCI : DCIconverterBase::D65), opt.temperature,
+													opt.normalize, opt.xyz_gamma, opt.precision) );
+			
+			preview.reset( new DCIconverterChain(*converter, *display) );
+		}
+		
+		const DCIconverterBase &conversion = (preview ? *preview : *converter);
+		
+		ConverterInstruments::SetEnabled(opt.stats || !opt.metrics.empty());
+		
+		const SequenceStats stats = (opt.mapped ? ConvertMapped(opt, conversion, convert_pool) :
+													ConvertEXR(opt, conversion, convert_pool));
+		
+		const ConverterStats counters = ConverterInstruments::Collect();
+		
+		if(opt.stats)
+		{
+			SequenceProcessor::PrintStats(stderr, stats);
+			PrintConverterStats(stderr, counters);
+		}
+		
+		if( !opt.metrics.empty() )
+			ConverterInstruments::WritePrometheus(opt.metrics, counters);
+	}
+	catch(const std::exception &e)
+	{
+		fprintf(stderr, "dciconvert: %s\n", e.what());
+		result = 1;
+	}
+	
+	// a failed run is when the timeline is most wanted
+	if( !opt.trace.empty() )
+	{
+		try
+		{
+			ConverterTrace::Stop();
+			ConverterTrace::WriteChromeTrace(opt.trace);
+		}
+		catch(const std::exception &e)
+		{
+			fprintf(stderr, "dciconvert: %s\n", e.what());
+			result = 1;
+		}
+	}
+	
+	return result;
+}